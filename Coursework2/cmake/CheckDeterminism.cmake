@@ -0,0 +1,38 @@
+# Runs headless in deterministic mode on one thread and on THREADS threads, and fails unless
+# the final states hash the same. Also prints the steps per second of each run, and of a run
+# on THREADS threads without deterministic mode, so the cost of determinism can be seen.
+#
+#   cmake -DHEADLESS=<path> -DTHREADS=<n> -DFRAMES=<n> [-DARGS=<more arguments>] -P CheckDeterminism.cmake
+
+if(NOT HEADLESS OR NOT THREADS OR NOT FRAMES)
+	message(FATAL_ERROR "HEADLESS, THREADS and FRAMES must be set")
+endif()
+
+function(run_headless threads deterministic hash_var rate_var)
+	set(args ${ARGS} --frames ${FRAMES} --threads ${threads} --hash)
+	if(deterministic)
+		list(APPEND args --deterministic)
+	endif()
+
+	execute_process(COMMAND ${HEADLESS} ${args} RESULT_VARIABLE result OUTPUT_VARIABLE output)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "headless ${args} failed (${result}):\n${output}")
+	endif()
+
+	string(REGEX MATCH "hash: ([0-9a-f]+)" unused "${output}")
+	set(${hash_var} "${CMAKE_MATCH_1}" PARENT_SCOPE)
+	string(REGEX MATCH "steps/sec: ([0-9.]+)" unused "${output}")
+	set(${rate_var} "${CMAKE_MATCH_1}" PARENT_SCOPE)
+endfunction()
+
+run_headless(1 ON singleHash singleRate)
+run_headless(${THREADS} ON multiHash multiRate)
+run_headless(${THREADS} OFF freeHash freeRate)
+
+message(STATUS "deterministic, 1 thread:       hash ${singleHash}, ${singleRate} steps/sec")
+message(STATUS "deterministic, ${THREADS} threads:      hash ${multiHash}, ${multiRate} steps/sec")
+message(STATUS "not deterministic, ${THREADS} threads:  ${freeRate} steps/sec")
+
+if(singleHash STREQUAL "" OR NOT singleHash STREQUAL multiHash)
+	message(FATAL_ERROR "1 and ${THREADS} threads gave different states: ${singleHash} and ${multiHash}")
+endif()
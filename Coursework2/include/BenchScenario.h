@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pworld.h"
+#include "pplatform.h"
+#include "pwalls.h"
+#include "ParticleCollision.h"
+#include "paabbtree.h"
+#include <vector>
+
+//The kinds of scene the benchmark can build, each of which stresses a different part of a step
+enum BenchScenarioType
+{
+	SCENARIO_GAS,			//Small spheres spread thinly over a box, bouncing off each other without gravity
+	SCENARIO_PILE,			//Spheres packed closely together, falling into a valley of platforms
+	SCENARIO_MIX,			//Spheres, quads and triangles in the blob demo's proportions, falling onto staggered platforms
+	SCENARIO_STACK,			//Columns of touching spheres standing on a floor
+	SCENARIO_PROJECTILES,	//Fast spheres fired into a field of resting ones
+	SCENARIO_COUNT
+};
+
+//A scene of any size, built from a seed so that the same arguments always give the same scene.
+//The particles live in a store of their own, so the world can run its passes over the whole store.
+class BenchScenario
+{
+	BenchScenarioType type;
+
+	//Declared before the particles, so that it outlives them
+	ParticleStore store;
+	std::vector<Particle> particles;
+
+	//The mix uses a tree for its broadphase, as the blob demo does; the other scenes have particles of
+	//much the same size, which suit the grid that ParticleCollision uses by default
+	ParticleCollision* particleCollision;
+	ParticleAABBTree broadphase;
+	std::vector<Platform*> platforms;
+
+	ParticleGravity gravity;
+	ParticleDrag drag;
+
+	ParticleWorld world;
+	ParticleWalls walls;
+
+	//State of the random number generator used to lay out the scene
+	unsigned random;
+
+	//Returns a random number in [min, max)
+	float randomFloat(float min, float max);
+
+	Particle& addSphere(float x, float y, float radius, float mass);
+	Particle& addPolygon(float x, float y, float radius, float mass, bool quad);
+	void addPlatform(const Vector2& start, const Vector2& end, float restitution);
+
+	//Lay out the particles and platforms of each kind of scene, in a box of the given half size
+	void buildGas(unsigned count, float& halfSize);
+	void buildPile(unsigned count, float& halfSize);
+	void buildMix(unsigned count, float& halfSize);
+	void buildStack(unsigned count, float& halfSize);
+	void buildProjectiles(unsigned count, float& halfSize);
+
+public:
+	BenchScenario(BenchScenarioType type, unsigned numParticles, unsigned seed = 1);
+	~BenchScenario();
+
+	//Runs the simulation for the given number of seconds, then keeps the particles inside the walls
+	void step(float duration);
+
+	ParticleWorld& getWorld() { return world; }
+	BenchScenarioType getType() const { return type; }
+	unsigned getParticleCount() const { return (unsigned)particles.size(); }
+
+	//Converts between scenario types and the names the benchmark uses for them.
+	//findType returns false if the name is not one of them.
+	static const char* getName(BenchScenarioType type);
+	static bool findType(const char* name, BenchScenarioType& type);
+
+private:
+	BenchScenario(const BenchScenario&);
+	BenchScenario& operator=(const BenchScenario&);
+};
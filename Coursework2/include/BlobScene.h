@@ -0,0 +1,68 @@
+#pragma once
+
+#include "pworld.h"
+#include "pplatform.h"
+#include "pwalls.h"
+#include "ParticleCollision.h"
+#include "paabbtree.h"
+
+const int NUM_SPHERES = 10; //Number of spheres in simulation
+const int NUM_QUADS = 1; //Number of quads in simulation (these will all be placed after spheres in the particle array)
+const int NUM_TRIANGLES = 1; //Number of triangles in simulation (these will all be placed after quads in the particle array)
+const int NUM_PARTICLES = NUM_SPHERES + NUM_QUADS + NUM_TRIANGLES; //Total number of particles of all kinds in simulation
+const int NUM_PLATFORMS = 1;
+const int BASE_SPHERE_RADIUS = 5; //Minimum radius of a sphere
+const int BASE_SPHERE_MASS = 5; //Minimum mass of a sphere
+
+//The blob demo's simulation, without any of its drawing, so that it can be stepped without a window:
+//the particles, the platforms they land on, the forces on them and the walls of the box they are in.
+class BlobScene
+{
+	Particle* blob;
+	ParticleCollision* particleCollision;
+
+	//Broadphase for particleCollision. A tree copes better than a grid with the mix of particle sizes.
+	ParticleAABBTree broadphase;
+
+	Platform* platform[NUM_PLATFORMS];
+
+	//Forces acting on every particle. The drag is a constant force against the velocity,
+	//strong enough to have a visible effect.
+	ParticleGravity gravity;
+	ParticleDrag drag;
+
+	ParticleWorld world;
+
+	//Box the particles are kept in. The demo moves the walls to the edges of its window.
+	ParticleWalls walls;
+
+	//Where each particle was before the last fixed step, to draw from between steps
+	Vector2 previousPosition[NUM_PARTICLES];
+
+public:
+	BlobScene();
+	~BlobScene();
+
+	//Runs the simulation for the given number of seconds, then keeps the particles inside the walls
+	void step(float duration);
+
+	//Runs one fixed step of the given number of seconds, as a number of shorter steps, remembering
+	//where the particles were before it
+	void fixedStep(float duration, unsigned substeps);
+
+	//Returns where to draw a particle, given how far (0 to 1) the time being drawn is from the
+	//start of the last fixed step to its end
+	Vector2 getRenderPosition(int index, float alpha) const;
+
+	ParticleWorld& getWorld() { return world; }
+	ParticleWalls& getWalls() { return walls; }
+
+	//Returns the particle array: NUM_SPHERES spheres, then NUM_QUADS quads, then NUM_TRIANGLES triangles
+	Particle* getParticles() { return blob; }
+
+	Platform* getPlatform(int index) { return platform[index]; }
+
+private:
+	BlobScene(const BlobScene&);
+	BlobScene& operator=(const BlobScene&);
+};
@@ -2,6 +2,8 @@
 
 #include "pcontacts.h"
 #include "particle.h"
+#include "pbroadphase.h"
+#include "pnarrow.h"
 #include <vector>
 
 using namespace std;
@@ -18,9 +20,33 @@ private:
 	//Default restitution value
 	float restitution = 0.9;
 
-	//Far borders of the convex polygon created by the Minkowski difference.
-	//Recalculated for every collision where at least one particle is not a circle.
-	vector<Vector2> MDVertices;
+	//Grid broadphase used unless the user supplies a different one
+	ParticleGridBroadphase defaultBroadphase;
+
+	//Broadphase used to find candidate pairs. If NULL, every pair of particles is tested.
+	ParticleBroadphase* broadphase;
+
+	//Job system the narrowphase is spread over, if any. Each thread writes the contacts it finds
+	//into its own list, and the lists are joined up afterwards.
+	JobSystem* jobs;
+	vector<vector<ParticleContact> > threadContacts;
+
+	//Contacts the last call to addContact found but had no room for, kept to be handed over
+	ParticleContactOverflow dropped;
+
+	//Runs the narrowphase on pairs [begin, end) of the broadphase's pairs, for the job system
+	static void generateRange(void* context, unsigned begin, unsigned end, unsigned thread);
+
+	//Writes a contact found to the next free place in the list, or keeps it if there is no room left
+	void addFound(const ParticleContact& found, ParticleContact *contact, unsigned& used, unsigned limit);
+
+	//Run the narrowphase on particles[i] and particles[j], filling in the contact if they are touching.
+	//One contact covers both particles, with particle[0] pushed along the normal and particle[1] against it.
+	bool generateContact(int i, int j, ParticleContact *contact);
+
+	//Tests two particles whose centres are the given squared distance apart. Pairs are rejected as cheaply as
+	//possible: first by their bounding circles, then by their bounding boxes, and only then by the exact test.
+	bool collide(Particle& particle1, Particle& particle2, float squareDistance, Vector2& normal, float& penetration);
 
 public:
 	//When instantiating particle collision object, tell it how many other particles there are to collide with
@@ -29,19 +55,27 @@ public:
 
 	void setRestitution(float restitution) { this->restitution = restitution; }
 
-	//Add all of the particle's current contact data to the relevant ParticleContact objects
+	//Allows the broadphase to be replaced (the caller keeps ownership). Passing NULL tests every pair.
+	void setBroadphase(ParticleBroadphase* broadphase);
+	ParticleBroadphase* getBroadphase() { return broadphase; }
+
+	//Spreads the broadphase and narrowphase over the job system's threads (NULL runs them on the calling thread)
+	void setJobSystem(JobSystem* jobs);
+
+	//Add all of the particle's current contact data to the relevant ParticleContact objects. Once limit
+	//contacts have been written, the rest are still found, and kept until addDroppedContacts asks for them.
 	unsigned addContact(ParticleContact *contact, unsigned limit);
 
-	//Determine if one particle and another are touching
-	bool checkCollision(Particle& particle1, Particle& particle2, float distance);
+	//Number of contacts the last call to addContact found but had no room for, and has not handed over
+	unsigned getContactsDropped() const { return dropped.getCount(); }
 
-	//Calculate vertices for Minkowski difference of two particles and return it as a vector of Vector2 objects
-	vector<Vector2> calcMinkowskiDifferenceVertices(Particle& particle1, Particle& particle2);
+	//Hands over the contacts the last call to addContact had no room for
+	unsigned addDroppedContacts(ParticleContact *contact, unsigned limit) { return dropped.take(contact, limit); }
 
-	//Calculates 8 of a sphere particle's vertices (this gives an imperfect representation of the shape, but
-	//is close enough for our purposes)
-	vector<Vector2> estimateSphereVertices(Particle& particle) const;
+	//Determine if one particle and another are touching
+	bool checkCollision(Particle& particle1, Particle& particle2, float distance);
 
-	//Determines whether the origin lies within the bounds of the calculated Minkowski difference
-	bool polygonContainsOrigin(vector<Vector2>& vertices);
+	//Determine if one particle and another are touching, and if so, the direction particle1 has to move
+	//to separate them (normal) and how far (penetration). distance is the distance between their centres.
+	bool checkCollision(Particle& particle1, Particle& particle2, float distance, Vector2& normal, float& penetration);
 };
\ No newline at end of file
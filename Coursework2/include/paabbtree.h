@@ -0,0 +1,176 @@
+/*
+ * Interface file for the dynamic bounding volume tree broadphase.
+ *
+ */
+#ifndef PAABBTREE_H
+#define PAABBTREE_H
+
+#include <vector>
+#include "pbroadphase.h"
+
+/**
+ * A broadphase that keeps the particles in a binary tree of axis aligned
+ * bounding boxes. Each particle's box is fattened by a margin, so the
+ * tree only changes when a particle moves out of its fattened box, and
+ * the tree is kept balanced with rotations as leaves are reinserted.
+ *
+ * Unlike the grid, the tree has no cell size to tune, so it copes with
+ * particles of very different sizes and with both dense and sparse scenes.
+ * It can also be used to find the particles in a region or along a ray.
+ */
+class ParticleAABBTree : public ParticleBroadphase
+{
+protected:
+	/**
+	 * Marks the absence of a node.
+	 */
+	static const int NULL_NODE = -1;
+
+	/**
+	 * A node in the tree. Leaves hold one particle each, and every
+	 * other node has exactly two children.
+	 */
+	struct Node
+	{
+		Vector2 min;
+		Vector2 max;
+
+		//Holds the parent for nodes in the tree, or the next free node for nodes in the free list
+		int parent;
+		int child1;
+		int child2;
+
+		//Leaves have a height of 0, free nodes a height of -1
+		int height;
+
+		unsigned particle;
+
+		bool isLeaf() const { return child1 == NULL_NODE; }
+	};
+
+	/**
+	 * Holds the node pool, the root of the tree, and the first free node.
+	 */
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+
+	/**
+	 * Holds the amount each particle's bounding box is grown by
+	 * before it is put into the tree.
+	 */
+	float margin;
+
+	/**
+	 * Holds the particle array the tree was built for. The tree is
+	 * rebuilt from scratch if this or the particle count changes.
+	 */
+	Particle* trackedParticles;
+	unsigned trackedCount;
+
+	/**
+	 * Holds the leaf for each particle, and each particle's exact bounds.
+	 */
+	std::vector<int> leaves;
+	std::vector<Vector2> mins;
+	std::vector<Vector2> maxs;
+
+	/**
+	 * Holds whether each particle can move (is awake, with finite mass).
+	 */
+	std::vector<char> active;
+
+	/**
+	 * Scratch stack for walking the tree.
+	 */
+	mutable std::vector<int> stack;
+
+	/**
+	 * Holds the job system the lookups are spread over, if any, and the
+	 * pairs and stack of each of its threads.
+	 */
+	JobSystem* jobs;
+	std::vector<std::vector<ParticlePair> > threadPairs;
+	std::vector<std::vector<int> > threadStacks;
+
+	/**
+	 * Looks up the exact bounds of particles [begin, end) in the tree,
+	 * adding the pairs found to the given list.
+	 */
+	void queryParticles(unsigned begin, unsigned end, std::vector<ParticlePair>& found, std::vector<int>& walk) const;
+
+	static void queryRange(void* context, unsigned begin, unsigned end, unsigned thread);
+
+	int allocateNode();
+	void freeNode(int node);
+
+	/**
+	 * Adds and removes leaves, rebalancing the tree on the way back up.
+	 */
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+
+	/**
+	 * Rotates the subtree at the given node if its children's heights differ
+	 * by more than one. Returns the node now at the top of the subtree.
+	 */
+	int balance(int node);
+
+	/**
+	 * Recalculates the bounds and heights of the given node and all of its ancestors.
+	 */
+	void refitAncestors(int node);
+
+	/**
+	 * Creates or moves the leaf for a particle, using its current exact bounds.
+	 */
+	void setLeafBounds(int leaf, unsigned particle);
+
+	void rebuild(Particle* particles, unsigned count);
+
+public:
+	/**
+	 * Creates a new tree, fattening every particle's bounds by the given margin.
+	 */
+	ParticleAABBTree(float margin = 2.0f);
+
+	/**
+	 * Sets the margin that particles' bounds are fattened by.
+	 */
+	void setMargin(float margin);
+
+	/**
+	 * Refits the leaves of any particles that have moved out of their
+	 * fattened bounds, then finds the pairs of particles whose exact
+	 * bounds overlap. Only particles that can move are looked up, so
+	 * sleeping and fixed particles cost almost nothing.
+	 */
+	virtual void update(Particle* particles, unsigned count);
+
+	/**
+	 * Spreads the lookups of each update over the job system's threads.
+	 */
+	virtual void setJobSystem(JobSystem* jobs);
+
+	/**
+	 * Fills results with the indices of the particles whose bounds
+	 * overlap the given region, as of the last update.
+	 */
+	void queryRegion(const Vector2& min, const Vector2& max, std::vector<unsigned>& results) const;
+
+	/**
+	 * Finds the first particle hit by a ray starting at origin and travelling
+	 * along direction for up to maxDistance (direction need not be unit length;
+	 * distances are measured in multiples of it). Spheres and polygons are
+	 * tested exactly. Returns the particle's index, or -1 if nothing was hit,
+	 * and fills in the distance to the hit if it is given somewhere to put it.
+	 */
+	int rayCast(const Vector2& origin, const Vector2& direction, float maxDistance, float* hitDistance = 0) const;
+
+	/**
+	 * Returns the height of the tree (0 for a single leaf, -1 when empty).
+	 */
+	int getHeight() const;
+};
+
+#endif // PAABBTREE_H
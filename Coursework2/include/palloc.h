@@ -0,0 +1,53 @@
+/*
+ * Interface file for counting heap allocations.
+ *
+ */
+#ifndef PALLOC_H
+#define PALLOC_H
+
+/**
+ * Holds a number of heap allocations and the bytes they asked for.
+ */
+struct AllocationCounts
+{
+	unsigned long long allocations;
+	unsigned long long bytes;
+
+	AllocationCounts() : allocations(0), bytes(0) {}
+};
+
+/**
+ * Counts the calls made to the global allocator (operator new, in all
+ * its forms) by every thread, so that the allocations made by a piece
+ * of code can be found by taking the counts before and after it.
+ *
+ * Counting replaces the global operator new and delete, so it is only
+ * compiled in when PALLOC_COUNT is defined. Without it the counts stay
+ * at zero and strict mode does nothing.
+ *
+ * In strict mode any allocation aborts the program, after saying how
+ * big it was. Turned on around a loop that should have stopped
+ * allocating (once it has warmed up), it turns an allocation on the
+ * hot path into a failure that points at it, rather than a slowdown.
+ */
+class AllocationCounter
+{
+public:
+	/**
+	 * Returns true if allocations are being counted.
+	 */
+	static bool isEnabled();
+
+	/**
+	 * Returns the allocations made so far.
+	 */
+	static AllocationCounts getCounts();
+
+	/**
+	 * Turns strict mode on or off.
+	 */
+	static void setStrict(bool strict);
+	static bool isStrict();
+};
+
+#endif // PALLOC_H
@@ -0,0 +1,123 @@
+/*
+ * Interface file for the arena that per-frame data is allocated from.
+ *
+ */
+#ifndef PARENA_H
+#define PARENA_H
+
+#include <stddef.h>
+#include <vector>
+#include <type_traits>
+
+/**
+ * Hands out memory for data that only lives for one frame, such as the
+ * contacts and the scratch space used while processing them, by bumping
+ * a pointer through a block of memory. Nothing is freed on its own:
+ * everything allocated is given back at once by reset, at the start of
+ * the next frame.
+ *
+ * If a frame needs more than the block holds, more blocks are added,
+ * and the next reset swaps them for one block big enough for all of
+ * them. Once the arena has seen the busiest frame, allocating from it
+ * never calls the global allocator.
+ *
+ * Memory is handed out raw: nothing is constructed or destroyed, so the
+ * arena is only for plain data.
+ */
+class FrameArena
+{
+protected:
+	/**
+	 * Holds one block of memory.
+	 */
+	struct Block
+	{
+		char* memory;
+		size_t size;
+	};
+
+	/**
+	 * Holds the blocks in use this frame. Allocations come from the
+	 * last of them.
+	 */
+	std::vector<Block> blocks;
+
+	/**
+	 * Holds the number of bytes used in the last block.
+	 */
+	size_t used;
+
+	/**
+	 * Holds the number of bytes in the blocks before the last, and
+	 * the most bytes used in any one frame.
+	 */
+	size_t usedBefore;
+	size_t highWater;
+
+	/**
+	 * Adds a block of at least the given size.
+	 */
+	void addBlock(size_t size);
+
+public:
+	/**
+	 * Creates an arena, with a block of the given size to begin with.
+	 */
+	FrameArena(size_t initialSize = 0);
+	~FrameArena();
+
+	/**
+	 * Returns size bytes of memory, aligned to the given alignment
+	 * (which must be a power of two). They stay valid until reset.
+	 */
+	void* allocate(size_t size, size_t alignment = 16);
+
+	/**
+	 * Returns room for count objects of type T, unconstructed. T has
+	 * to be plain data, which can be copied into the room as it is and
+	 * left there without being destroyed.
+	 */
+	template <class T>
+	T* allocate(unsigned count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+			"FrameArena only holds plain data");
+
+		return (T*)allocate(count * sizeof(T), alignof(T));
+	}
+
+	/**
+	 * Gives back everything allocated since the last reset. If more
+	 * than one block was needed, they are replaced by one that holds
+	 * as much as all of them.
+	 */
+	void reset();
+
+	/**
+	 * Returns the bytes allocated since the last reset, the bytes the
+	 * arena holds, and the most bytes allocated between two resets.
+	 */
+	size_t getUsed() const;
+	size_t getCapacity() const;
+	size_t getHighWater() const;
+
+private:
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+};
+
+/**
+ * Makes room in the vector for at least count elements. When it has to
+ * grow, room is made for twice that, so a count that creeps up frame by
+ * frame does not allocate every frame. Per-frame lists that are sized
+ * to this frame's contacts (by reserve or assign, which allocate no
+ * more than they are asked for) should be grown with this first.
+ */
+template <class T>
+void reserveGrowing(std::vector<T>& vector, size_t count)
+{
+	if (vector.capacity() < count)
+		vector.reserve(count * 2);
+}
+
+#endif // PARENA_H
@@ -8,14 +8,18 @@
 #define PARTICLE_H
 
 #include "coreMath.h"
+#include "pstore.h"
 #include <vector>
 
 class Particle
 {
 protected:
 
-	float inverseMass;
-	float radius;
+	//Position, velocity, force accumulator, acceleration, inverse mass and radius are kept in
+	//a ParticleStore, so that whole-world passes can run over them in bulk. The particle holds
+	//its slot in the store, and the rest of its (less frequently used) data itself.
+	ParticleStore* store;
+	unsigned index;
 
 	//True if particle is a sphere, false if it is a convex polygon
 	bool sphere = true;
@@ -25,12 +29,27 @@ protected:
 	float width;
 	float height;
 
-	Vector2 position;
-	Vector2 velocity;
-	Vector2 forceAccum;
-	Vector2 acceleration;
+	//Radius of the smallest circle about the position that contains the shape, and the shape's
+	//bounding box relative to the position. Kept up to date by setRadius and setVertices.
+	float boundingRadius;
+	Vector2 localMin;
+	Vector2 localMax;
 
 public:
+	//Creates a particle in the default store, or in the given store
+	Particle();
+	explicit Particle(ParticleStore& store);
+
+	//Copies get their own slot in the same store as the original
+	Particle(const Particle& other);
+	Particle(Particle&& other);
+	Particle& operator=(const Particle& other);
+	~Particle();
+
+	//Returns the store holding this particle, and its slot in the store
+	ParticleStore* getStore() const;
+	unsigned getStoreIndex() const;
+
 	void integrate(float duration);
 	void setMass(const float mass);
 	float getMass() const;
@@ -59,6 +78,11 @@ public:
 	void setRadius(const float r);
 	float getRadius() const;
 
+	//Bounding volumes for quickly ruling out collisions. The bounding radius is the radius for a
+	//sphere, or the distance to the furthest vertex for a polygon. getBounds gives the world space box.
+	float getBoundingRadius() const;
+	void getBounds(Vector2& min, Vector2& max) const;
+
 	void setVelocity(const Vector2 &velocity);
 	void setVelocity(const float x, const float y);
 	Vector2 getVelocity() const;
@@ -71,6 +95,15 @@ public:
 	void clearAccumulator();
 	void addForce(const Vector2 &force);
 
+	//Sleeping particles are not moved by forces, integrated or resolved until something wakes them.
+	//Adding a force or setting a non-zero velocity wakes a particle, and putting it to sleep stops it.
+	bool isAwake() const;
+	void setAwake(const bool awake = true);
+
+	//Returns how long the particle has been moving slowly enough to sleep, and sets it
+	float getSleepTime() const;
+	void setSleepTime(const float time);
+
 };
 
 #endif
\ No newline at end of file
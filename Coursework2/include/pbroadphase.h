@@ -0,0 +1,133 @@
+/*
+ * Interface file for the broadphase collision detection system for particles.
+ *
+ */
+#ifndef PBROADPHASE_H
+#define PBROADPHASE_H
+
+#include <vector>
+#include "particle.h"
+
+class JobSystem;
+
+/**
+ * A pair of particles whose bounding boxes overlap, and which should
+ * therefore be handed to the narrowphase. The two values are indices
+ * into the particle array the broadphase was updated with, and first
+ * is always smaller than second.
+ */
+struct ParticlePair
+{
+	unsigned first;
+	unsigned second;
+};
+
+/**
+ * This is the basic polymorphic interface for broadphases. A broadphase
+ * cheaply culls particle pairs that cannot possibly be touching, so that
+ * the narrowphase only has to test the pairs that might be.
+ */
+class ParticleBroadphase
+{
+protected:
+	/**
+	 * Holds the candidate pairs found by the last update.
+	 */
+	std::vector<ParticlePair> pairs;
+
+public:
+	virtual ~ParticleBroadphase() {}
+
+	/**
+	 * Finds every pair of particles in the given array whose
+	 * bounding boxes overlap. Pairs in which neither particle can
+	 * move (because they are asleep or have infinite mass) can never
+	 * need a contact, and may be left out.
+	 */
+	virtual void update(Particle* particles, unsigned count) = 0;
+
+	/**
+	 * Returns the candidate pairs found by the last update.
+	 */
+	const std::vector<ParticlePair>& getPairs() const { return pairs; }
+
+	/**
+	 * Gives the broadphase a job system to spread its work over (or
+	 * NULL to run on the calling thread). Broadphases that cannot use
+	 * one ignore it.
+	 */
+	virtual void setJobSystem(JobSystem*) {}
+
+	/**
+	 * Calculates the world space bounding box of a particle. Spheres are
+	 * bounded by their radius, polygons by the extents of their vertices.
+	 */
+	static void calcBounds(Particle& particle, Vector2& min, Vector2& max);
+};
+
+/**
+ * A broadphase that hashes particles into a uniform grid of square cells.
+ * Only particles that share a cell are tested against each other, so the
+ * cost of an update grows with the number of particles rather than the
+ * number of pairs, provided the cell size is close to the particle size.
+ */
+class ParticleGridBroadphase : public ParticleBroadphase
+{
+protected:
+	/**
+	 * One entry per cell overlapped by each particle.
+	 */
+	struct CellEntry
+	{
+		int cellX;
+		int cellY;
+		unsigned particle;
+	};
+
+	/**
+	 * Holds the side length of a cell. If this is zero the cell size is
+	 * chosen at each update to fit the largest particle.
+	 */
+	float cellSize;
+
+	/**
+	 * Holds the cell size used by the last update.
+	 */
+	float usedCellSize;
+
+	/**
+	 * Scratch storage, kept between updates so that stepping does not
+	 * reallocate once the scene has settled.
+	 */
+	std::vector<Vector2> mins;
+	std::vector<Vector2> maxs;
+	std::vector<CellEntry> entries;
+	std::vector<CellEntry> buckets;
+	std::vector<unsigned> bucketStart;
+
+	/**
+	 * Returns the hash bucket that the given cell belongs in.
+	 */
+	unsigned hashCell(int cellX, int cellY, unsigned mask) const;
+
+public:
+	/**
+	 * Creates a new grid broadphase. A cell size of zero lets the
+	 * grid pick its own cell size each update.
+	 */
+	ParticleGridBroadphase(float cellSize = 0);
+
+	/**
+	 * Sets the side length of a grid cell (zero for automatic).
+	 */
+	void setCellSize(float cellSize);
+
+	/**
+	 * Returns the cell size that was used by the last update.
+	 */
+	float getCellSize() const;
+
+	virtual void update(Particle* particles, unsigned count);
+};
+
+#endif // PBROADPHASE_H
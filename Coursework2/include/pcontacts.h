@@ -6,10 +6,13 @@
 #ifndef PCONTACTS_H
 #define PCONTACTS_H
 
+#include <vector>
 #include "particle.h"
 
 
 class ParticleContactResolver;
+struct ParticleIsland;
+class JobSystem;
 
 /**
  * A Contact represents two objects in contact (in this case
@@ -45,6 +48,39 @@ public:
 	 */
 	float penetration;
 
+	/**
+	 * Identifies the pair of objects in contact, so that the same
+	 * contact can be recognised from one frame to the next. Contact
+	 * generators set this with makePairId or makeSceneryPairId.
+	 */
+	unsigned long long pairId;
+
+	/**
+	 * Returns the id for a contact between two particles, given their
+	 * indices. The id is the same whichever way round they are given.
+	 */
+	static unsigned long long makePairId(unsigned a, unsigned b)
+	{
+		if (a > b)
+		{
+			unsigned temp = a;
+			a = b;
+			b = temp;
+		}
+
+		return ((unsigned long long)a << 32) | b;
+	}
+
+	/**
+	 * Returns the id for a contact between a particle and a piece
+	 * of scenery (such as a platform). These never clash with the
+	 * ids of contacts between two particles.
+	 */
+	static unsigned long long makeSceneryPairId(unsigned particle, unsigned scenery)
+	{
+		return ((unsigned long long)(0x80000000u | scenery) << 32) | particle;
+	}
+
 
 protected:
 	/**
@@ -83,6 +119,217 @@ protected:
 	 */
 	unsigned iterationsUsed;
 
+	/**
+	 * True if contacts are resolved with sequential impulses rather
+	 * than one at a time, most closing first.
+	 */
+	bool sequentialImpulses;
+
+	/**
+	 * Holds the number of passes over the contacts sequential
+	 * impulses make.
+	 */
+	unsigned impulseIterations;
+
+	/**
+	 * Holds the closing velocity below which contacts do not bounce
+	 * when using sequential impulses. Resting contacts close a little
+	 * every frame under gravity, so this has to be above that speed.
+	 */
+	float restitutionThreshold;
+
+	/**
+	 * Holds what the sequential impulse solver needs to know about
+	 * each contact: the velocity it is aiming for along the normal,
+	 * the mass the impulse acts on, and the total impulse applied so
+	 * far (which is never allowed to pull the particles together).
+	 */
+	struct ImpulseConstraint
+	{
+		float targetVelocity;
+		float effectiveMass;
+		float accumulatedImpulse;
+	};
+	std::vector<ImpulseConstraint> constraints;
+
+	/**
+	 * Holds the total impulse applied at each contact last frame, by
+	 * pair id and sorted, so that a contact that persists can start
+	 * from where it finished (warm starting).
+	 */
+	struct CachedImpulse
+	{
+		unsigned long long pairId;
+		float impulse;
+
+		bool operator<(const CachedImpulse& other) const
+		{
+			return pairId < other.pairId;
+		}
+	};
+	std::vector<CachedImpulse> impulseCache;
+	std::vector<CachedImpulse> nextImpulseCache;
+
+	/**
+	 * Applies an impulse along the contact normal to the contact's
+	 * particles, pushing them apart if it is positive. Particles with
+	 * infinite mass are left alone (not even written to), so contacts
+	 * that share only such a particle can be solved at the same time.
+	 */
+	static void applyImpulse(ParticleContact& contact, float impulse);
+
+	/**
+	 * Nudges a contact towards its target velocity.
+	 */
+	static void solveImpulse(ParticleContact& contact, ImpulseConstraint& constraint);
+
+	/**
+	 * Resolves the contacts with sequential impulses, with a fixed
+	 * number of passes over each island (or over all of the contacts,
+	 * if there are no islands).
+	 */
+	void resolveImpulses(ParticleContact *contactArray, unsigned numContacts,
+		const ParticleIsland* islands, unsigned numIslands, float duration);
+
+	/**
+	 * Makes the sequential impulse passes over a range of contacts.
+	 */
+	void solveImpulses(ParticleContact *contactArray, unsigned begin, unsigned end);
+
+	/**
+	 * Holds the job system sequential impulses are spread over, or
+	 * NULL to solve them on the calling thread.
+	 */
+	JobSystem* jobs;
+
+	/**
+	 * True if sequential impulses are always solved a colour at a time,
+	 * with or without a job system, so that the result is the same
+	 * however many threads there are.
+	 */
+	bool deterministic;
+
+	/**
+	 * The number of colours contacts are sorted into. Contacts that
+	 * cannot be given one of them go in one last batch, which is
+	 * solved on the calling thread.
+	 */
+	static const unsigned MAX_COLOURS = 64;
+
+	/**
+	 * Holds the moving particle at each end of each contact that was
+	 * coloured (or NULL), so that the colouring can be reused while
+	 * the same contacts come in.
+	 */
+	std::vector<Particle*> colouredEnds;
+
+	/**
+	 * Holds the moving particles of the coloured contacts, sorted, and
+	 * the colours used by the contacts on each of them (one bit each).
+	 */
+	std::vector<Particle*> colourParticles;
+	std::vector<unsigned long long> particleColours;
+
+	/**
+	 * Holds the colour of each contact, the contacts grouped by colour
+	 * (keeping their order within each), and where each colour starts
+	 * in that list (with the end of the last one after it). colourNext
+	 * is used while the contacts are being grouped.
+	 */
+	std::vector<unsigned> contactColour;
+	std::vector<unsigned> colourOrder;
+	std::vector<unsigned> colourBegin;
+	std::vector<unsigned> colourNext;
+
+	/**
+	 * Sorts the contacts into colours, so that no two contacts of the
+	 * same colour move the same particle, unless the contacts are the
+	 * same as last time, when the last colouring still holds.
+	 */
+	void colourContacts(ParticleContact *contactArray, unsigned numContacts);
+
+	/**
+	 * Makes the sequential impulse passes over the contacts a colour
+	 * at a time, solving the contacts of each colour in parallel.
+	 */
+	void solveColouredImpulses(ParticleContact *contactArray);
+
+	/**
+	 * Holds what the threads solving a colour need to know.
+	 */
+	struct ColourBatch
+	{
+		ParticleContactResolver* resolver;
+		ParticleContact* contactArray;
+		const unsigned* contacts;
+	};
+
+	/**
+	 * Solves contacts [begin, end) of a colour, for the job system.
+	 */
+	static void solveColourRange(void* context, unsigned begin, unsigned end, unsigned thread);
+
+	/**
+	 * Holds one end of a contact: the particle, and the contact's
+	 * index times two plus which end of the contact it is.
+	 */
+	struct ContactEnd
+	{
+		Particle* particle;
+		unsigned end;
+
+		bool operator<(const ContactEnd& other) const
+		{
+			if (particle != other.particle)
+				return particle < other.particle;
+
+			return end < other.end;
+		}
+	};
+
+	/**
+	 * Holds the ends of all the contacts sorted by particle, so that
+	 * the contacts touching a particle are together. endBegin and
+	 * endFinish give the run of ends sharing the particle at each end
+	 * of each contact.
+	 */
+	std::vector<ContactEnd> ends;
+	std::vector<unsigned> endBegin;
+	std::vector<unsigned> endFinish;
+
+	/**
+	 * Holds an indexed binary heap of the contacts, ordered by their
+	 * separating velocity (lowest first), the position of each contact
+	 * in the heap, and the velocity each contact is ordered by. Contacts
+	 * that do not need resolving are ordered as if it were infinite.
+	 */
+	std::vector<unsigned> heap;
+	std::vector<unsigned> heapPosition;
+	std::vector<float> heapKey;
+
+	/**
+	 * Works out the value the contact is ordered by in the heap.
+	 */
+	static float calculateKey(const ParticleContact& contact);
+
+	/**
+	 * Returns true if contact a should be resolved before contact b.
+	 */
+	bool heapBefore(unsigned a, unsigned b) const;
+
+	/**
+	 * Moves the contact at the given heap position up or down the
+	 * heap until it is in order.
+	 */
+	void heapSiftUp(unsigned position);
+	void heapSiftDown(unsigned position);
+
+	/**
+	 * Recalculates the key of every contact that shares a particle
+	 * with the given contact, and moves them in the heap to suit.
+	 */
+	void updateNeighbours(ParticleContact *contactArray, unsigned contact);
+
 public:
 	/**
 	 * Creates a new contact resolver.
@@ -94,16 +341,133 @@ public:
 	 */
 	void setIterations(unsigned iterations);
 
+	/**
+	 * Switches between resolving contacts one at a time, most closing
+	 * first (the default), and sequential impulses.
+	 *
+	 * Sequential impulses make a number of passes over all the
+	 * contacts, keeping a running total of the impulse at each contact
+	 * and clamping the total (rather than each impulse) so that it only
+	 * ever pushes. The totals are remembered between frames by pair id,
+	 * and a contact that persists starts from last frame's total. A
+	 * resting stack therefore starts out already close to balanced, and
+	 * a handful of passes (4 to 8) is enough to settle it. Overlap is
+	 * corrected a fraction at a time, leaving a small slop so that
+	 * resting contacts persist from frame to frame.
+	 */
+	void setSequentialImpulses(bool sequentialImpulses, unsigned impulseIterations = 6);
+	bool usesSequentialImpulses() const;
+
+	/**
+	 * Sets the closing velocity below which contacts do not bounce
+	 * when using sequential impulses.
+	 */
+	void setRestitutionThreshold(float restitutionThreshold);
+
+	/**
+	 * Spreads sequential impulses over the given job system's threads,
+	 * or with NULL (the default), solves them on the calling thread.
+	 *
+	 * Contacts sharing a particle cannot be solved at the same time, so
+	 * the contacts are coloured such that no two of a colour move the
+	 * same particle, and each pass solves the colours in turn, with the
+	 * contacts of a colour shared between the threads. Each contact
+	 * still sees the impulses of those solved before it, as when solving
+	 * on one thread, but the contacts are taken in colour order. The
+	 * result does not depend on the number of threads.
+	 */
+	void setJobSystem(JobSystem* jobs);
+
+	/**
+	 * Makes sequential impulses solve the contacts a colour at a time
+	 * even without a job system (or with one of a single thread), so
+	 * that a simulation gives the same result on any number of threads.
+	 * Given the contacts in the same order, the result is then the same
+	 * to the bit.
+	 */
+	void setDeterministic(bool deterministic);
+
+	/**
+	 * Returns the iterations used by the last call to resolveContacts:
+	 * the passes made by sequential impulses, or the number of contacts
+	 * resolved one at a time.
+	 */
+	unsigned getIterationsUsed() const;
+
+	/**
+	 * Returns the fastest any of the given contacts is closing (zero
+	 * if none are), to show how well they have been resolved.
+	 */
+	static float calculateMaxClosingVelocity(const ParticleContact *contactArray, unsigned numContacts);
+
 	/**
 	 * Resolves a set of particle contacts for both penetration
 	 * and velocity.
 	 *
+	 * Each iteration resolves the contact with the lowest separating
+	 * velocity. Resolving a contact only changes the velocities of its
+	 * two particles, so only the contacts sharing one of them have to
+	 * be looked at again: the contacts are kept in a heap, and an
+	 * iteration costs O(log C) per neighbouring contact rather than a
+	 * scan of all C contacts.
+	 */
+	void resolveContacts(ParticleContact *contactArray,
+		unsigned numContacts,
+		float duration);
+
+	/**
+	 * Resolves a set of particle contacts that has been split into
+	 * islands (see ParticleIslands), resolving each island on its own.
+	 * When resolving contacts one at a time, each island is given the
+	 * full number of iterations.
 	 */
 	void resolveContacts(ParticleContact *contactArray,
 		unsigned numContacts,
+		const ParticleIsland* islands,
+		unsigned numIslands,
 		float duration);
 };
 
+/**
+ * Holds the contacts a generator found but had no room to write, so
+ * that it can hand them over once there is room, rather than having
+ * to generate them again.
+ */
+class ParticleContactOverflow
+{
+protected:
+	/**
+	 * Holds the contacts, and how many of them have been handed over.
+	 */
+	std::vector<ParticleContact> contacts;
+	unsigned taken;
+
+public:
+	ParticleContactOverflow();
+
+	/**
+	 * Forgets the contacts held, keeping the room for them.
+	 */
+	void clear();
+
+	/**
+	 * Keeps a copy of the given contact.
+	 */
+	void add(const ParticleContact& contact);
+
+	/**
+	 * Returns the number of contacts held that have not been handed
+	 * over yet.
+	 */
+	unsigned getCount() const;
+
+	/**
+	 * Writes the contacts not handed over yet, no more than limit of
+	 * them, and returns the number written.
+	 */
+	unsigned take(ParticleContact *contact, unsigned limit);
+};
+
 /**
  * This is the basic polymorphic interface for contact generators
  * applying to particles.
@@ -111,12 +475,48 @@ public:
 class ParticleContactGenerator
 {
 public:
+	/**
+	 * Returned by getContactsDropped by generators that do not count
+	 * the contacts they had no room for.
+	 */
+	static const unsigned UNCOUNTED = ~0u;
+
+	virtual ~ParticleContactGenerator() {}
+
 	/**
 	 * Fills the given contact structure with the generated
-	 * contact.
+	 * contact, writing no more than limit contacts, and returns the
+	 * number written. It is called once each frame, except for a
+	 * generator that does not count what it drops (see
+	 * getContactsDropped): if that uses up the whole limit, it may be
+	 * called again in the same frame with more room, so generating
+	 * contacts must not change anything else.
 	 */
 	virtual unsigned addContact(ParticleContact *contact,
 		unsigned limit) = 0;
+
+	/**
+	 * Returns the number of contacts the last call to addContact
+	 * found but had no room to write, and has not handed over since
+	 * with addDroppedContacts, or UNCOUNTED if the generator stops
+	 * once the limit is used up without counting what it loses.
+	 */
+	virtual unsigned getContactsDropped() const { return UNCOUNTED; }
+
+	/**
+	 * Writes the contacts the last call to addContact had no room
+	 * for, no more than limit of them, and returns the number
+	 * written. Generators that count what they drop must keep those
+	 * contacts for this.
+	 */
+	virtual unsigned addDroppedContacts(ParticleContact*, unsigned) { return 0; }
+
+	/**
+	 * Gives the generator a job system to spread its work over (or
+	 * NULL to run on the calling thread). Generators that cannot use
+	 * one ignore it.
+	 */
+	virtual void setJobSystem(JobSystem*) {}
 };
 
 #endif // CONTACTS_H
\ No newline at end of file
@@ -0,0 +1,172 @@
+/*
+ * Interface file for the force generators that act on particles.
+ *
+ */
+#ifndef PFGEN_H
+#define PFGEN_H
+
+#include <vector>
+#include "particle.h"
+
+/**
+ * A force generator can be asked to add a force to one or more
+ * particles.
+ */
+class ParticleForceGenerator
+{
+public:
+	virtual ~ParticleForceGenerator() {}
+
+	/**
+	 * Overload this in implementations of the interface to calculate
+	 * and update the force applied to the given particle.
+	 */
+	virtual void updateForce(Particle* particle, float duration) = 0;
+
+	/**
+	 * Generators whose force can be described by ParticleForceTerms
+	 * add their terms here and return true. The world then applies all
+	 * such generators together, in one pass over its particles, instead
+	 * of calling updateForce for each particle. Other generators leave
+	 * the terms alone and return false.
+	 */
+	virtual bool addBatchTerms(ParticleForceTerms& terms) const;
+};
+
+/**
+ * Holds all the force generators and the particles they apply to.
+ */
+class ParticleForceRegistry
+{
+protected:
+	/**
+	 * Keeps track of one force generator and the particle it
+	 * applies to.
+	 */
+	struct ParticleForceRegistration
+	{
+		Particle* particle;
+		ParticleForceGenerator* fg;
+	};
+
+	/**
+	 * Holds the list of registrations.
+	 */
+	typedef std::vector<ParticleForceRegistration> Registry;
+	Registry registrations;
+
+public:
+	/**
+	 * Registers the given force generator to apply to the given
+	 * particle.
+	 */
+	void add(Particle* particle, ParticleForceGenerator* fg);
+
+	/**
+	 * Removes the given registered pair from the registry. If the
+	 * pair is not registered, this method will have no effect.
+	 */
+	void remove(Particle* particle, ParticleForceGenerator* fg);
+
+	/**
+	 * Clears all registrations from the registry. This will not
+	 * delete the particles or the force generators themselves, just
+	 * the records of their connection.
+	 */
+	void clear();
+
+	/**
+	 * Calls all the force generators to update the forces of their
+	 * corresponding particles.
+	 */
+	void updateForces(float duration);
+};
+
+/**
+ * A force generator that applies a gravitational force. One instance
+ * can be used for multiple particles.
+ */
+class ParticleGravity : public ParticleForceGenerator
+{
+	/** Holds the acceleration due to gravity. */
+	Vector2 gravity;
+
+public:
+	/** Creates the generator with the given acceleration. */
+	ParticleGravity(const Vector2& gravity);
+
+	/** Applies the gravitational force to the given particle. */
+	virtual void updateForce(Particle* particle, float duration);
+
+	virtual bool addBatchTerms(ParticleForceTerms& terms) const;
+};
+
+/**
+ * A force generator that applies a drag force, directly against the
+ * velocity, of magnitude k0 + k1 * speed + k2 * speed * speed. One
+ * instance can be used for multiple particles.
+ */
+class ParticleDrag : public ParticleForceGenerator
+{
+	/** Holds the constant drag. */
+	float k0;
+
+	/** Holds the velocity drag coefficient. */
+	float k1;
+
+	/** Holds the velocity squared drag coefficient. */
+	float k2;
+
+public:
+	/** Creates the generator with the given coefficients. */
+	ParticleDrag(float k0, float k1, float k2);
+
+	/** Applies the drag force to the given particle. */
+	virtual void updateForce(Particle* particle, float duration);
+
+	virtual bool addBatchTerms(ParticleForceTerms& terms) const;
+};
+
+/**
+ * A force generator that applies a spring force.
+ */
+class ParticleSpring : public ParticleForceGenerator
+{
+	/** The particle at the other end of the spring. */
+	Particle* other;
+
+	/** Holds the spring constant. */
+	float springConstant;
+
+	/** Holds the rest length of the spring. */
+	float restLength;
+
+public:
+	/** Creates a new spring with the given parameters. */
+	ParticleSpring(Particle* other, float springConstant, float restLength);
+
+	/** Applies the spring force to the given particle. */
+	virtual void updateForce(Particle* particle, float duration);
+};
+
+/**
+ * A force generator that hands the particle to a user supplied
+ * function, along with a pointer the user can use for their own data.
+ */
+class ParticleForceCallback : public ParticleForceGenerator
+{
+public:
+	typedef void (*Callback)(Particle* particle, float duration, void* data);
+
+protected:
+	Callback callback;
+	void* data;
+
+public:
+	ParticleForceCallback(Callback callback, void* data = 0);
+
+	/** Calls the function for the given particle. */
+	virtual void updateForce(Particle* particle, float duration);
+};
+
+#endif // PFGEN_H
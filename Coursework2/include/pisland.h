@@ -0,0 +1,96 @@
+/*
+ * Interface file for splitting contacts into independent islands.
+ *
+ */
+#ifndef PISLAND_H
+#define PISLAND_H
+
+#include <vector>
+#include "pcontacts.h"
+
+/**
+ * A group of contacts that affect each other, and the particles they
+ * move. Contacts in different islands share no moving particle, so
+ * islands can be resolved independently of each other.
+ */
+struct ParticleIsland
+{
+	/**
+	 * Holds the island's range of the contact array.
+	 */
+	unsigned contactBegin;
+	unsigned contactCount;
+
+	/**
+	 * Holds the island's range of ParticleIslands::getParticles().
+	 */
+	unsigned particleBegin;
+	unsigned particleCount;
+};
+
+/**
+ * Finds the islands in a set of contacts by running union-find over
+ * the graph whose nodes are particles and whose edges are contacts.
+ * Particles with infinite mass (and scenery) are never moved by a
+ * contact, so they do not join islands together: a pile resting on a
+ * platform is an island of its own, whatever else rests on the platform.
+ */
+class ParticleIslands
+{
+protected:
+	/**
+	 * Holds the islands found by the last call to build.
+	 */
+	std::vector<ParticleIsland> islands;
+
+	/**
+	 * Holds the moving particles of each island, grouped by island.
+	 */
+	std::vector<Particle*> islandParticles;
+
+	/**
+	 * Holds the particles in the contacts, sorted so that each can be
+	 * given a node number, and the union-find parent of each node.
+	 */
+	std::vector<Particle*> nodes;
+	std::vector<unsigned> parent;
+
+	/**
+	 * Holds the island of each contact and of each node, and the
+	 * island each root node has been numbered as.
+	 */
+	std::vector<unsigned> contactIsland;
+	std::vector<unsigned> nodeIsland;
+	std::vector<unsigned> rootIsland;
+
+	/**
+	 * Holds the contacts while they are sorted into islands.
+	 */
+	std::vector<ParticleContact> sorted;
+
+	unsigned findNode(Particle* particle) const;
+	unsigned findRoot(unsigned node);
+	void join(unsigned a, unsigned b);
+
+public:
+	/**
+	 * Finds the islands in the given contacts, and reorders the contacts
+	 * so that each island is a single range of the array. Contacts keep
+	 * their order within an island, and islands are numbered in the
+	 * order their first contact came in.
+	 */
+	void build(ParticleContact *contactArray, unsigned numContacts);
+
+	/**
+	 * Returns the islands found by the last call to build.
+	 */
+	const std::vector<ParticleIsland>& getIslands() const;
+
+	/**
+	 * Returns the moving particles of all the islands, grouped by
+	 * island. Particles that are in no contact are in no island.
+	 */
+	const std::vector<Particle*>& getParticles() const;
+};
+
+#endif // PISLAND_H
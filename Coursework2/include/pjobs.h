@@ -0,0 +1,124 @@
+/*
+ * Interface file for the job system that spreads work over threads.
+ *
+ */
+#ifndef PJOBS_H
+#define PJOBS_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/**
+ * A pool of worker threads that run ranges of a loop in parallel.
+ *
+ * The threads are started once, when the job system is created, and
+ * sleep between loops, so a job system can be used every frame without
+ * any threads being created. The thread that calls parallelFor joins in
+ * as thread 0.
+ *
+ * A loop is cut into chunks, which are dealt out to a queue for each
+ * thread. Each thread works from the front of its own queue, and once
+ * that is empty, steals chunks from the back of the others', so that
+ * threads that finish early help with the rest of the work.
+ */
+class JobSystem
+{
+public:
+	/**
+	 * The function run for each chunk of a loop: it is given the
+	 * context passed to parallelFor, the range of the loop to do, and
+	 * the index of the thread running it (below getThreadCount()), which
+	 * it can use to pick per-thread storage without locking.
+	 */
+	typedef void (*RangeFunction)(void* context, unsigned begin, unsigned end, unsigned thread);
+
+protected:
+	/**
+	 * Holds one chunk of a loop.
+	 */
+	struct Task
+	{
+		RangeFunction function;
+		void* context;
+		unsigned begin;
+		unsigned end;
+	};
+
+	/**
+	 * Holds the chunks waiting to be run by one thread: those from
+	 * head to the end of tasks. The owner takes chunks from the head,
+	 * and others steal them from the end. Chunks are only added once
+	 * the queue is empty, which starts it again from the beginning, so
+	 * the queue reuses its memory from one loop to the next.
+	 */
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::vector<Task> tasks;
+		unsigned head;
+
+		TaskQueue() : head(0) {}
+	};
+
+	/**
+	 * Holds the queue of each thread (including the calling thread,
+	 * at index 0), and the worker threads.
+	 */
+	std::vector<TaskQueue*> queues;
+	std::vector<std::thread> workers;
+
+	/**
+	 * Holds the number of chunks of the current loop not yet finished.
+	 */
+	std::atomic<unsigned> pending;
+
+	/**
+	 * Used to wake the workers when there is a loop to run, and to
+	 * tell them to finish.
+	 */
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	unsigned generation;
+	bool quit;
+
+	/**
+	 * Takes a chunk from the thread's own queue, or failing that steals
+	 * one from another thread's. Returns false if there was none.
+	 */
+	bool takeTask(unsigned thread, Task& task);
+
+	/**
+	 * Runs chunks until there are none left to take.
+	 */
+	void runTasks(unsigned thread);
+
+	void workerLoop(unsigned thread);
+
+public:
+	/**
+	 * Creates a job system with the given number of threads, counting
+	 * the calling thread. Zero means one per hardware thread, and one
+	 * runs everything on the calling thread, which is useful when
+	 * debugging.
+	 */
+	JobSystem(unsigned threadCount = 0);
+	~JobSystem();
+
+	/**
+	 * Returns the number of threads, counting the calling thread.
+	 */
+	unsigned getThreadCount() const;
+
+	/**
+	 * Runs function over the range [0, count), in chunks of grainSize
+	 * (or an even share of the range if grainSize is zero), and returns
+	 * once all of them are done. Loops may not be nested: the function
+	 * must not call parallelFor itself.
+	 */
+	void parallelFor(unsigned count, unsigned grainSize, RangeFunction function, void* context);
+};
+
+#endif // PJOBS_H
@@ -0,0 +1,87 @@
+/*
+ * Interface file for the narrowphase collision tests between convex shapes.
+ *
+ */
+#ifndef PNARROW_H
+#define PNARROW_H
+
+#include "particle.h"
+
+/**
+ * A convex shape as seen by the narrowphase: a set of vertices given
+ * relative to a position, rounded off by a radius. A sphere is a single
+ * vertex with a radius, and a polygon has a radius of zero. Shapes only
+ * point at vertex data held elsewhere, so making one never allocates.
+ */
+struct ConvexShape
+{
+	Vector2 position;
+	const Vector2* vertices;
+	unsigned count;
+	float radius;
+
+	/**
+	 * Sets up the shape for a particle, using its vertices if it is a
+	 * polygon, or its centre and radius if it is a sphere.
+	 */
+	void setParticle(Particle& particle);
+
+	/**
+	 * Returns the point of the shape that is furthest in the given direction.
+	 * The radius is included exactly, so spheres are true circles.
+	 */
+	Vector2 support(const Vector2& direction) const;
+};
+
+/**
+ * Tests for contact between pairs of convex shapes using the
+ * Gilbert-Johnson-Keerthi (GJK) algorithm, which finds whether the
+ * Minkowski difference of the two shapes contains the origin, and the
+ * Expanding Polytope Algorithm (EPA), which then finds how far the
+ * shapes have to move to separate. Both only ever look at the shapes
+ * through their support functions, so a test costs O(n + m) for shapes
+ * with n and m vertices and no memory is allocated.
+ */
+class ConvexCollision
+{
+public:
+	/**
+	 * Holds the most vertices the expanding polytope may grow to.
+	 */
+	static const unsigned MAX_POLYTOPE = 32;
+
+	/**
+	 * Returns true if the two shapes overlap (or touch). If they do, the
+	 * normal is set to the direction that shape a has to move to get
+	 * out of shape b, and penetration to the distance it has to move.
+	 */
+	static bool intersect(const ConvexShape& a, const ConvexShape& b, Vector2& normal, float& penetration);
+
+	/**
+	 * Tests a circle against a convex polygon (a shape with no radius)
+	 * exactly, by finding the feature of the polygon closest to the
+	 * circle's centre. Returns true if they overlap, in which case the
+	 * normal is the direction the circle has to move to get out of the
+	 * polygon, and penetration the distance it has to move.
+	 */
+	static bool circlePolygon(const Vector2& centre, float radius, const ConvexShape& polygon,
+		Vector2& normal, float& penetration);
+
+	/**
+	 * Returns true if the two shapes overlap, without working out
+	 * the penetration. The final simplex is left in simplex. Shapes
+	 * for which it does not converge within its limit of iterations
+	 * (which only happens when they barely touch) are reported as
+	 * not overlapping.
+	 */
+	static bool gjk(const ConvexShape& a, const ConvexShape& b, Vector2 simplex[3], unsigned& simplexCount);
+
+	/**
+	 * Expands the simplex found by gjk to find the point of the
+	 * Minkowski difference's boundary closest to the origin.
+	 */
+	static void epa(const ConvexShape& a, const ConvexShape& b, const Vector2 simplex[3], unsigned simplexCount,
+		Vector2& normal, float& penetration);
+};
+
+#endif // PNARROW_H
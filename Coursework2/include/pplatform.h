@@ -0,0 +1,61 @@
+/*
+ * Interface file for platforms that particles can rest on.
+ *
+ */
+#ifndef PPLATFORM_H
+#define PPLATFORM_H
+
+#include <vector>
+#include "pcontacts.h"
+
+/**
+ * Platforms are two dimensional: lines on which the
+ * particles can rest. Platforms are also contact generators for the physics.
+ */
+class Platform : public ParticleContactGenerator
+{
+public:
+	Vector2 start;
+	Vector2 end;
+
+	/**
+	 * Identifies this platform in the ids of its contacts.
+	 */
+	unsigned id;
+
+	/**
+	 * Holds pointers to the particles we're checking for collisions with.
+	 */
+	std::vector<Particle*> particle;
+
+	/**
+	 * Holds the restitution of contacts with the platform.
+	 */
+	float restitution;
+
+	Platform();
+
+	void setRestitution(float restitution) { this->restitution = restitution; }
+
+	virtual unsigned addContact(ParticleContact *contact, unsigned limit);
+
+	/**
+	 * Returns the number of contacts the last call to addContact had
+	 * no room for, and has not handed over since.
+	 */
+	virtual unsigned getContactsDropped() const;
+
+	/**
+	 * Hands over the contacts the last call to addContact had no room
+	 * for.
+	 */
+	virtual unsigned addDroppedContacts(ParticleContact *contact, unsigned limit);
+
+protected:
+	/**
+	 * Holds the contacts the last call to addContact had no room for.
+	 */
+	ParticleContactOverflow dropped;
+};
+
+#endif // PPLATFORM_H
@@ -0,0 +1,136 @@
+/*
+ * Interface file for the structure of arrays particle storage.
+ *
+ */
+#ifndef PSTORE_H
+#define PSTORE_H
+
+#include <vector>
+
+/**
+ * Holds the forces that act on every particle in a world alike, in a
+ * form that can be applied to a whole store in one pass: a constant
+ * acceleration (such as gravity), and a drag force against the velocity
+ * of magnitude drag0 + drag1 * speed + drag2 * speed * speed.
+ */
+struct ParticleForceTerms
+{
+	float gravityX;
+	float gravityY;
+	float drag0;
+	float drag1;
+	float drag2;
+
+	ParticleForceTerms() : gravityX(0), gravityY(0), drag0(0), drag1(0), drag2(0) {}
+};
+
+/**
+ * Holds the frequently used state of many particles as separate,
+ * aligned arrays of floats (a structure of arrays), so that whole-world
+ * passes such as integration read memory in order and can be run four
+ * or eight particles at a time with SSE or AVX.
+ *
+ * Each particle owns a slot in a store, and Particle objects are handles
+ * onto their slots. Slots that are not in use have zero inverse mass and
+ * zero radius, and are asleep, so the kernels can run over every slot
+ * without checking.
+ */
+class ParticleStore
+{
+public:
+	/**
+	 * Holds the number of floats the arrays are aligned to and padded
+	 * to a multiple of (enough for one AVX register).
+	 */
+	static const unsigned WIDTH = 8;
+
+	/**
+	 * The particle state, one array per component.
+	 */
+	float* positionX;
+	float* positionY;
+	float* velocityX;
+	float* velocityY;
+	float* forceX;
+	float* forceY;
+	float* accelerationX;
+	float* accelerationY;
+	float* inverseMass;
+	float* radius;
+
+	/**
+	 * Holds 1 for particles that are awake and 0 for those that are
+	 * asleep, and how long each particle has been moving slowly enough
+	 * to sleep.
+	 */
+	float* awake;
+	float* sleepTime;
+
+protected:
+	/**
+	 * Holds the number of slots allocated, the number of slots up
+	 * to and including the last used one, and the number in use.
+	 */
+	unsigned capacity;
+	unsigned size;
+	unsigned live;
+
+	/**
+	 * Holds the slots below size that have been released.
+	 */
+	std::vector<unsigned> freeSlots;
+
+	void grow(unsigned newCapacity);
+	void clearSlot(unsigned slot);
+
+public:
+	/**
+	 * Creates a store with room for the given number of particles.
+	 * The store grows as more slots are needed.
+	 */
+	ParticleStore(unsigned capacity = 64);
+	~ParticleStore();
+
+	/**
+	 * Returns a free slot, with all of its values zeroed, awake.
+	 */
+	unsigned allocate();
+
+	/**
+	 * Returns the slot to the store.
+	 */
+	void release(unsigned slot);
+
+	/**
+	 * Returns the number of slots a pass over the store has to cover
+	 * (always a multiple of WIDTH).
+	 */
+	unsigned getSize() const;
+
+	/**
+	 * Returns the number of slots in use.
+	 */
+	unsigned getLiveCount() const;
+
+	/**
+	 * Integrates the particles in slots [begin, end) forward in time by the
+	 * given duration, and clears their force accumulators. Particles with
+	 * zero inverse mass, and particles that are asleep, are left alone.
+	 */
+	void integrate(float duration, unsigned begin, unsigned end);
+
+	/**
+	 * Adds the forces described by the terms to the force accumulator
+	 * of each particle in slots [begin, end), in a single pass. Particles
+	 * with zero inverse mass, and particles that are asleep, are left
+	 * alone, and drag only acts on particles that are moving.
+	 */
+	void applyForces(const ParticleForceTerms& terms, unsigned begin, unsigned end);
+
+	/**
+	 * Returns the store that particles go in if no other is given.
+	 */
+	static ParticleStore& getDefault();
+};
+
+#endif // PSTORE_H
@@ -0,0 +1,134 @@
+/*
+ * Interface file for the sweep and prune broadphase.
+ *
+ */
+#ifndef PSWEEP_H
+#define PSWEEP_H
+
+#include <vector>
+#include <unordered_map>
+#include "pbroadphase.h"
+
+/**
+ * A broadphase that keeps the ends of every particle's bounding box in
+ * sorted lists between updates. Particles only move a little each frame,
+ * so an insertion sort puts the lists back in order in close to linear
+ * time, and every swap it makes tells us that a pair has started or
+ * stopped overlapping. The cost of an update therefore depends on how
+ * much the particles moved, not on how many pairs there are.
+ *
+ * By default only the x axis is swept, and the pairs found are then
+ * filtered on y. Sweeping both axes keeps the overlapping set exact at
+ * the cost of a second sort.
+ */
+class ParticleSweepAndPrune : public ParticleBroadphase
+{
+protected:
+	/**
+	 * One end of a particle's bounding box on one axis. The particle
+	 * index is stored shifted up by one, with the lowest bit set if
+	 * this is the maximum end.
+	 */
+	struct Endpoint
+	{
+		float value;
+		unsigned data;
+
+		unsigned particle() const { return data >> 1; }
+		bool isMax() const { return (data & 1) != 0; }
+	};
+
+	/**
+	 * A pair that overlaps on every swept axis. When only x is swept,
+	 * touching records whether the pair also overlaps on y.
+	 */
+	struct TrackedPair
+	{
+		ParticlePair pair;
+		bool touching;
+	};
+
+	/**
+	 * True if both axes are swept.
+	 */
+	bool bothAxes;
+
+	/**
+	 * Holds the particle array the lists were built for. The lists are
+	 * rebuilt from scratch if this or the particle count changes.
+	 */
+	Particle* trackedParticles;
+	unsigned trackedCount;
+
+	/**
+	 * Holds the sorted endpoint lists, one per axis.
+	 */
+	std::vector<Endpoint> endpoints[2];
+
+	/**
+	 * Holds the current bounds of each particle.
+	 */
+	std::vector<Vector2> mins;
+	std::vector<Vector2> maxs;
+
+	/**
+	 * Holds the overlapping pairs, and where each one is in that list.
+	 */
+	std::vector<TrackedPair> tracked;
+	std::unordered_map<unsigned long long, unsigned> trackedIndex;
+
+	/**
+	 * Holds the pairs that started or stopped touching during the
+	 * last update.
+	 */
+	std::vector<ParticlePair> addedPairs;
+	std::vector<ParticlePair> removedPairs;
+
+	/**
+	 * Scratch list of the boxes that are open during the initial sweep.
+	 */
+	std::vector<unsigned> open;
+
+	/**
+	 * Returns true if the bounds of the two particles overlap on the axis.
+	 */
+	bool overlaps(unsigned a, unsigned b, unsigned axis) const;
+
+	/**
+	 * Starts and stops tracking a pair of particles.
+	 */
+	void addPair(unsigned a, unsigned b);
+	void removePair(unsigned a, unsigned b);
+
+	/**
+	 * Builds the lists from scratch for a new particle array.
+	 */
+	void rebuild(Particle* particles, unsigned count);
+
+	/**
+	 * Puts one axis back into order after the particles have moved,
+	 * adding and removing pairs as ends cross.
+	 */
+	void sortAxis(unsigned axis);
+
+public:
+	/**
+	 * Creates a new sweep and prune broadphase, sweeping x only
+	 * unless bothAxes is true.
+	 */
+	ParticleSweepAndPrune(bool bothAxes = false);
+
+	virtual void update(Particle* particles, unsigned count);
+
+	/**
+	 * Returns the pairs that started touching during the last update.
+	 */
+	const std::vector<ParticlePair>& getAddedPairs() const { return addedPairs; }
+
+	/**
+	 * Returns the pairs that stopped touching during the last update.
+	 */
+	const std::vector<ParticlePair>& getRemovedPairs() const { return removedPairs; }
+};
+
+#endif // PSWEEP_H
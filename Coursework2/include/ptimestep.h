@@ -0,0 +1,122 @@
+/*
+ * Interface file for running a simulation at a fixed rate.
+ *
+ */
+#ifndef PTIMESTEP_H
+#define PTIMESTEP_H
+
+/**
+ * Turns the wall-clock time between frames into a whole number of
+ * steps of a fixed length, so that the simulation runs at the same
+ * rate, and gives the same results, however often the frames come.
+ *
+ * Each frame, the time since the last one is passed to advance, which
+ * adds it to an accumulator and returns how many steps it now holds.
+ * Each step can be split into a number of substeps, for a simulation
+ * that needs a shorter step than the rate it is wanted at.
+ *
+ * The time left over, less than a step, is carried to the next frame.
+ * Drawing the simulation as it was at the end of the last step would
+ * make it judder, so getAlpha gives how far the time left over is
+ * into the next step, for the drawing to interpolate between the
+ * last two steps with.
+ *
+ * If the steps take longer to run than the time they cover, each
+ * frame has more time to catch up on than the last. To stop this
+ * growing without bound, no more than a maximum number of steps is
+ * returned by each call to advance, and any more time than that is
+ * dropped: the simulation then runs slower than real time, rather
+ * than not at all.
+ */
+class FixedTimestep
+{
+protected:
+	/**
+	 * Holds the length of each step, in seconds.
+	 */
+	double stepDuration;
+
+	/**
+	 * Holds the number of substeps each step is run as.
+	 */
+	unsigned substeps;
+
+	/**
+	 * Holds the most steps that one call to advance will return.
+	 */
+	unsigned maxSteps;
+
+	/**
+	 * Holds the time, in seconds, not yet covered by a step.
+	 */
+	double accumulator;
+
+	/**
+	 * Holds the time, in seconds, that has been dropped to stay
+	 * within the maximum number of steps.
+	 */
+	double droppedTime;
+
+	/**
+	 * Holds the number of steps returned so far.
+	 */
+	unsigned long long stepsRun;
+
+public:
+	FixedTimestep(float stepDuration = 0.01f, unsigned substeps = 1, unsigned maxSteps = 5);
+
+	/**
+	 * Sets the length of each step, in seconds.
+	 */
+	void setStepDuration(float stepDuration);
+	float getStepDuration() const;
+
+	/**
+	 * Sets the number of substeps each step is run as (at least one).
+	 */
+	void setSubsteps(unsigned substeps);
+	unsigned getSubsteps() const;
+
+	/**
+	 * Returns the length of each substep, in seconds: the length the
+	 * simulation should be run for, getSubsteps() times, for each step.
+	 */
+	float getSubstepDuration() const;
+
+	/**
+	 * Sets the most steps that one call to advance will return (at
+	 * least one).
+	 */
+	void setMaxSteps(unsigned maxSteps);
+	unsigned getMaxSteps() const;
+
+	/**
+	 * Adds the given number of seconds to the time to be simulated,
+	 * and returns the number of steps to run to catch up with it.
+	 */
+	unsigned advance(double elapsed);
+
+	/**
+	 * Returns how far, from 0 to 1, the time not yet simulated is
+	 * into the next step.
+	 */
+	float getAlpha() const;
+
+	/**
+	 * Returns the time, in seconds, dropped so far because there was
+	 * too much to catch up on.
+	 */
+	double getDroppedTime() const;
+
+	/**
+	 * Returns the number of steps returned by advance so far.
+	 */
+	unsigned long long getStepsRun() const;
+
+	/**
+	 * Forgets the time not yet simulated and the figures kept so far.
+	 */
+	void reset();
+};
+
+#endif // PTIMESTEP_H
@@ -0,0 +1,194 @@
+/*
+ * Interface file for tracing where the time in a frame goes.
+ *
+ */
+#ifndef PTRACE_H
+#define PTRACE_H
+
+#include <atomic>
+#include <chrono>
+
+/**
+ * Records timed zones of code into a ring buffer for each thread, and
+ * writes them out as Chrome trace-event JSON, which chrome://tracing
+ * and the Perfetto UI can both open.
+ *
+ * Zones are marked with PTRACE_ZONE, which times the rest of the
+ * enclosing block. The zones are only compiled in when PTRACE is
+ * defined; without it the macros are empty and nothing is recorded.
+ * Compiled in, tracing is still off until setEnabled(true) is called,
+ * and a zone costs no more than a relaxed load and a branch while it
+ * is.
+ *
+ * Each thread records into a buffer of its own, so recording takes no
+ * locks: the buffer is allocated the first time the thread records,
+ * and once full, the oldest zones are written over. The buffers are
+ * kept when their threads finish, so their zones can still be written
+ * out. Zones are written out on demand, with writeChromeTrace, or
+ * whenever a frame (a zone marked with PTRACE_FRAME) takes longer
+ * than a threshold, so the frames leading up to a spike can be seen.
+ * A slow frame only notes how far each buffer had got when it ended;
+ * the file is written by writePendingDumps, which is called between
+ * frames, so that writing it does not make the frame slower still.
+ *
+ * The names of zones are not copied, so must be string literals (or
+ * otherwise outlive the trace).
+ */
+class Tracer
+{
+	/**
+	 * Holds whether zones are being recorded.
+	 */
+	static std::atomic<bool> enabled;
+
+public:
+	/**
+	 * Returns true if the zones were compiled in (PTRACE was defined
+	 * when the physics were built).
+	 */
+	static bool isAvailable();
+
+	/**
+	 * Turns recording on or off. Without PTRACE this does nothing.
+	 */
+	static void setEnabled(bool enabled);
+
+	/**
+	 * Returns true if zones are being recorded.
+	 */
+	static bool isEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Sets the number of zones each thread's buffer holds (rounded up
+	 * to a power of two). This only applies to buffers created after
+	 * it is called, so should be set before anything is recorded.
+	 */
+	static void setBufferSize(unsigned zones);
+
+	/**
+	 * Names the calling thread in the traces written out.
+	 */
+	static void setThreadName(const char* name);
+
+	/**
+	 * Writes out a frame whenever one takes longer than the given
+	 * number of nanoseconds, to a file named after the prefix and the
+	 * number of the frame, up to the given number of files. A
+	 * threshold of zero stops it. The files are only written when
+	 * writePendingDumps is called.
+	 */
+	static void setSlowFrameDump(unsigned long long thresholdNs, const char* pathPrefix, unsigned maxDumps = 8);
+
+	/**
+	 * Writes out the slow frames noted since it was last called, each
+	 * with the zones recorded up to the end of the frame (less any
+	 * written over since). Returns the number of files written. It
+	 * should be called between frames, by the thread that runs them.
+	 */
+	static unsigned writePendingDumps();
+
+	/**
+	 * Returns the number of slow frames written out so far.
+	 */
+	static unsigned getSlowFrameDumps();
+
+	/**
+	 * Writes the zones held by every thread's buffer to the given file
+	 * as Chrome trace-event JSON. Returns false if the file could not
+	 * be written. Zones recorded while it runs may be left out, so it
+	 * is best called between frames.
+	 */
+	static bool writeChromeTrace(const char* path);
+
+	/**
+	 * Forgets the zones recorded so far.
+	 */
+	static void clear();
+
+	/**
+	 * Returns the time, in nanoseconds, that zones are timed with.
+	 */
+	static unsigned long long now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	 * Records a zone on the calling thread.
+	 */
+	static void record(const char* name, unsigned long long begin, unsigned long long end);
+
+	/**
+	 * Notes the end of a frame of the given length, and if it was
+	 * slow, how far each thread's buffer had got, for
+	 * writePendingDumps to write out. Frames should only be ended by
+	 * one thread.
+	 */
+	static void endFrame(unsigned long long durationNs);
+};
+
+/**
+ * Records the time from its creation to its destruction as a zone, if
+ * tracing was on when it was created.
+ */
+class TraceZone
+{
+protected:
+	const char* name;
+	unsigned long long begin;
+
+public:
+	TraceZone(const char* name)
+		: name(Tracer::isEnabled() ? name : 0), begin(this->name ? Tracer::now() : 0)
+	{
+	}
+
+	~TraceZone()
+	{
+		if (name)
+			Tracer::record(name, begin, Tracer::now());
+	}
+
+private:
+	TraceZone(const TraceZone&);
+	TraceZone& operator=(const TraceZone&);
+};
+
+/**
+ * A zone that is a whole frame, so is checked against the slow frame
+ * threshold once it has been recorded.
+ */
+class TraceFrame : public TraceZone
+{
+public:
+	TraceFrame(const char* name) : TraceZone(name) {}
+
+	~TraceFrame()
+	{
+		if (!name)
+			return;
+
+		unsigned long long end = Tracer::now();
+		Tracer::record(name, begin, end);
+		Tracer::endFrame(end - begin);
+
+		//So that the zone is not recorded twice
+		name = 0;
+	}
+};
+
+#ifdef PTRACE
+#define PTRACE_CONCAT_INNER(a, b) a##b
+#define PTRACE_CONCAT(a, b) PTRACE_CONCAT_INNER(a, b)
+#define PTRACE_ZONE(name) TraceZone PTRACE_CONCAT(traceZone, __LINE__)(name)
+#define PTRACE_FRAME(name) TraceFrame PTRACE_CONCAT(traceFrame, __LINE__)(name)
+#else
+#define PTRACE_ZONE(name)
+#define PTRACE_FRAME(name)
+#endif
+
+#endif // PTRACE_H
@@ -0,0 +1,59 @@
+/*
+ * Interface file for the walls that keep particles in a box.
+ *
+ */
+#ifndef PWALLS_H
+#define PWALLS_H
+
+#include "particle.h"
+
+/**
+ * A box centred on the origin that particles bounce around inside. A
+ * particle that reaches a wall has its velocity towards it reversed,
+ * and one that ends up outside (which happens when the box is made
+ * smaller, as when the demo's window is resized) is moved back in.
+ *
+ * The walls are applied after each step of the world, rather than
+ * being a contact generator, so they act on the particles directly.
+ */
+class ParticleWalls
+{
+protected:
+	/**
+	 * Holds the distance from the centre to the side walls, and to
+	 * the top and bottom walls.
+	 */
+	float halfWidth;
+	float halfHeight;
+
+public:
+	ParticleWalls(float halfWidth = 100.0f, float halfHeight = 100.0f);
+
+	/**
+	 * Moves the walls.
+	 */
+	void setBounds(float halfWidth, float halfHeight);
+
+	/**
+	 * Bounces the given particles off the walls, and moves any that
+	 * are outside back in.
+	 */
+	void resolve(Particle* particles, unsigned numParticles) const;
+
+	/**
+	 * Reverses the particle's velocity towards any wall it has reached.
+	 */
+	void boxCollisionResolve(Particle* particle) const;
+
+	/**
+	 * Returns true if the particle is (partly) outside the box.
+	 */
+	bool outOfBoxTest(Particle* particle) const;
+
+	/**
+	 * Moves the particle back inside the box.
+	 */
+	void outOfBoxResolve(Particle* particle) const;
+};
+
+#endif // PWALLS_H
@@ -6,14 +6,72 @@
 #define PWORLD_H
 
 #include <vector> 
+#include <chrono>
 #include "pcontacts.h"
+#include "pfgen.h"
+#include "pisland.h"
+#include "pjobs.h"
+#include "parena.h"
+#include "palloc.h"
 
+/**
+ * The stages of ParticleWorld::runPhysics, for the figures kept about
+ * each of them. Applying forces includes getting the frame arena ready,
+ * and resolving includes everything after the contacts are generated:
+ * ordering them, waking particles, finding islands and sleeping.
+ */
+enum ParticleWorldStage
+{
+	STAGE_FORCES,
+	STAGE_INTEGRATE,
+	STAGE_PARTICLE_CONTACTS,
+	STAGE_PLATFORM_CONTACTS,
+	STAGE_RESOLVE,
+	STAGE_COUNT
+};
+
+/**
+ * Holds figures about one step of a ParticleWorld.
+ */
+struct ParticleWorldStats
+{
+	/**
+	 * Holds the time each stage took, in nanoseconds, and the heap
+	 * allocations made in it (see AllocationCounter).
+	 */
+	unsigned long long stageTime[STAGE_COUNT];
+	AllocationCounts stageAllocations[STAGE_COUNT];
+
+	/**
+	 * Holds the number of contacts generated, and the number that were
+	 * found but lost because the contact limit was reached. Only
+	 * generators that count what they lose (see
+	 * ParticleContactGenerator::getContactsDropped) add to the second.
+	 */
+	unsigned contacts;
+	unsigned droppedContacts;
+
+	/**
+	 * Holds the iterations the resolver used: the passes made by
+	 * sequential impulses, or the contacts resolved one at a time.
+	 */
+	unsigned iterationsUsed;
+
+	/**
+	 * Holds the fastest any contact was still closing after the
+	 * contacts were resolved (zero if none were).
+	 */
+	float maxClosingVelocity;
+
+	ParticleWorldStats();
+};
 
 class ParticleWorld
 {
 public:
 	typedef std::vector<Particle*> Particles;
 	typedef std::vector<ParticleContactGenerator*> ContactGenerators;
+	typedef std::vector<ParticleForceGenerator*> ForceGenerators;
 
 protected:
 	/**
@@ -32,6 +90,77 @@ protected:
 	 */
 	ParticleContactResolver resolver;
 
+	/**
+	 * Holds the force generators that apply to every particle in the
+	 * world, and the registry of those that only apply to some.
+	 */
+	ForceGenerators forceGenerators;
+	ParticleForceRegistry registry;
+
+	/**
+	 * Holds the force generators that could not be batched in the
+	 * current step, to be applied to each particle in turn. Kept
+	 * between steps so that it reuses its memory.
+	 */
+	ForceGenerators unbatchedGenerators;
+
+	/**
+	 * Holds the islands the contacts were split into this frame.
+	 */
+	ParticleIslands islands;
+
+	/**
+	 * True if particles that have been moving slowly for a while are
+	 * put to sleep. Holds the speed below which a particle counts as
+	 * slow, and how long it has to be slow for before it sleeps.
+	 */
+	bool sleeping;
+	float sleepSpeed;
+	float timeToSleep;
+
+	/**
+	 * Holds where an island that went to sleep together has its
+	 * particles in sleepingParticles.
+	 */
+	struct SleepingIsland
+	{
+		unsigned particleBegin;
+		unsigned particleCount;
+	};
+
+	/**
+	 * Holds the islands of more than one particle that are asleep,
+	 * and their particles, island after island, so that when any of
+	 * an island's particles is woken the rest can be woken with it.
+	 * They are kept between steps so that they reuse their memory.
+	 */
+	std::vector<SleepingIsland> sleepingIslands;
+	Particles sleepingParticles;
+
+	/**
+	 * Holds the job system the passes over the particles are spread
+	 * over, or NULL to run them on the calling thread.
+	 */
+	JobSystem* jobs;
+
+	/**
+	 * True if the simulation gives the same result to the bit however
+	 * many threads it is spread over.
+	 */
+	bool deterministic;
+
+	/**
+	 * Holds what getBatchStore last found, and the store and live
+	 * count it was found for. It is only looked for again once the
+	 * list of particles has been handed out by getParticles, or the
+	 * number of particles in the store has changed, so the particles
+	 * are not all visited to check it every step.
+	 */
+	mutable ParticleStore* batchStore;
+	mutable ParticleStore* batchCandidate;
+	mutable unsigned batchLiveCount;
+	mutable bool batchStoreValid;
+
 	/**
 	 * Contact generators.
 	 */
@@ -39,21 +168,107 @@ protected:
 	ContactGenerators particleContactGenerator;
 
 	/**
-	 * Holds the list of contacts.
+	 * Holds the memory for everything that only lasts one frame. It is
+	 * reset at the start of each call to runPhysics.
+	 */
+	FrameArena arena;
+
+	/**
+	 * Holds this frame's list of contacts (allocated from the arena
+	 * when contacts are first generated), and the room in it. The room
+	 * starts out small, and grows to fit the most contacts generated in
+	 * any one frame, so it follows the scene rather than the worst case.
 	 */
 	ParticleContact *contacts;
+	unsigned contactCapacity;
 
 	/**
-	 * Holds the maximum number of contacts allowed (i.e. the
-	 * size of the contacts array).
+	 * Holds the maximum number of contacts allowed per frame. The
+	 * list never grows beyond this.
 	 */
 	unsigned maxContacts;
 
+	/**
+	 * Holds the most contacts generated in any one frame so far.
+	 */
+	unsigned contactHighWater;
+
+	/**
+	 * True if a contact generator ran out of room in the last frame,
+	 * with the list already at the maximum, so may have lost contacts.
+	 */
+	bool contactLimitReached;
+
+	/**
+	 * Has the given generator add its contacts to the list from the
+	 * given position. If it fills the room it was given, the list is
+	 * grown and the generator hands over the contacts it kept (or,
+	 * if it does not keep them, is asked again). Returns the number
+	 * of contacts added.
+	 */
+	unsigned addContacts(ParticleContactGenerator* generator, unsigned next);
+
+	/**
+	 * Has each of the given generators add its contacts to the list
+	 * in turn, from the given position. Returns the number added.
+	 */
+	unsigned addContacts(ContactGenerators& generators, unsigned next);
+
+	/**
+	 * Gets the list of contacts ready to be generated into.
+	 */
+	void prepareContacts();
+
+	/**
+	 * Holds the figures for the last step, and the time and allocation
+	 * counts when the current stage began.
+	 */
+	ParticleWorldStats stats;
+	std::chrono::steady_clock::time_point stageStartTime;
+	AllocationCounts stageStart;
+
+	/**
+	 * Holds the number of steps the stage times are kept for.
+	 */
+	static const unsigned STATS_WINDOW = 256;
+
+	/**
+	 * Holds the time of each stage, and of the whole step, in each of
+	 * the last STATS_WINDOW steps (oldest first from historyNext), the
+	 * number of steps held, and space for picking percentiles from them.
+	 */
+	unsigned long long stageHistory[STAGE_COUNT + 1][STATS_WINDOW];
+	unsigned historyCount;
+	unsigned historyNext;
+	mutable unsigned long long percentileScratch[STATS_WINDOW];
+
+	/**
+	 * Adds the last step's stage times to the history.
+	 */
+	void recordHistory();
+
+	/**
+	 * Marks the start of the first stage of a step, and the end of
+	 * each stage, recording what happened in it.
+	 */
+	void beginStages();
+	void endStage(ParticleWorldStage stage);
+
+	/**
+	 * Returns the store holding the particles if it holds this
+	 * world's particles and no others, so that passes over all of
+	 * the particles can be run over the whole store at once.
+	 * Otherwise returns null, and each particle is processed alone.
+	 */
+	ParticleStore* getBatchStore() const;
+	ParticleStore* findBatchStore() const;
+
 public:
 
 	/**
 	 * Creates a new particle simulator that can handle up to the
-	 * given number of contacts per frame.
+	 * given number of contacts per frame. Room for the contacts is
+	 * only made as they are generated.
 	 */
 	ParticleWorld(unsigned maxContacts, unsigned iterations = 0);
 
@@ -65,25 +280,178 @@ public:
 	/**
 	 * Calls each of the registered contact generators to report
 	 * their contacts. Returns the number of generated contacts.
+	 * Once the maximum number of contacts is reached, the rest are
+	 * lost (isContactLimitReached returns true, and the world's
+	 * figures say how many were dropped). The platform
+	 * generators are called first, so that it is contacts between
+	 * particles that are lost, and particles are never let through
+	 * the scenery because the particles used up the limit. The time
+	 * and allocations of the two contact stages are recorded in the
+	 * world's figures.
 	 */
 	unsigned generateContacts();
 
+	/**
+	 * Sets the maximum number of contacts allowed per frame, and
+	 * returns it.
+	 */
+	void setContactLimit(unsigned maxContacts);
+	unsigned getContactLimit() const;
+
+	/**
+	 * Returns the number of contacts there is room for, and the most
+	 * contacts generated in any one frame so far.
+	 */
+	unsigned getContactCapacity() const;
+	unsigned getContactHighWater() const;
+
+	/**
+	 * Returns true if contacts may have been lost in the last frame,
+	 * because the maximum number of contacts was reached.
+	 */
+	bool isContactLimitReached() const;
+
+	/**
+	 * Adds the forces from all the force generators to the particles.
+	 * Generators that apply to every particle and can be batched are
+	 * combined and applied in a single pass.
+	 */
+	void applyForces(float duration);
+
 	/**
 	 * Integrates all the particles in this world forward in time
 	 * by the given duration.
 	 */
 	void integrate(float duration);
 
+	/**
+	 * Wakes the sleeping particles that an awake particle has come
+	 * into contact with.
+	 */
+	void wakeTouched(unsigned numContacts);
+
+	/**
+	 * Wakes the rest of every sleeping island that has had one of
+	 * its particles woken, and forgets those islands.
+	 */
+	void wakeIslands();
+
+	/**
+	 * Updates how long each particle has been moving slowly, and puts
+	 * particles to sleep once they have been slow for long enough. The
+	 * particles in an island only ever sleep together, and are
+	 * remembered so that they wake together too.
+	 */
+	void updateSleep(float duration);
+
 	/**
 	 * Processes all the physics for the particle world.
 	 */
 	void runPhysics(float duration);
 
 	/**
-	 *  Returns the list of particles.
+	 * Turns sleeping on or off (it is off to begin with). With it on,
+	 * particles that move slower than the given speed for the given
+	 * time go to sleep, along with everything in contact with them.
+	 * Sleeping particles are not moved by world-wide forces, integrated,
+	 * or tested against each other or the scenery, until an awake
+	 * particle touches them or they are given a force or velocity.
+	 * Particles that went to sleep in contact with each other are all
+	 * woken when any one of them is.
+	 */
+	void setSleeping(bool sleeping, float sleepSpeed = 1.0f, float timeToSleep = 0.5f);
+
+	/**
+	 * Spreads the force, integration, contact generation and
+	 * sequential impulse passes over the given job system's threads
+	 * (the caller keeps ownership).
+	 * Passing NULL runs them all on the calling thread. Contact
+	 * generators added after this is called need to be given the job
+	 * system themselves.
+	 */
+	void setJobSystem(JobSystem* jobs);
+
+	/**
+	 * Turns determinism on or off (it is off to begin with).
+	 *
+	 * Contact generators spread over a job system report their contacts
+	 * in an order that depends on which thread got to which part of the
+	 * work first, and the resolver solves contacts in a different order
+	 * with and without threads. With determinism on, the contacts are
+	 * sorted by pair id once they have been generated (keeping the order
+	 * of those with the same id, which come from different generators),
+	 * and the resolver always solves them a colour at a time. Replays on
+	 * any number of threads, or without a job system, then match to the
+	 * bit, as long as the contact limit is never reached (which contacts
+	 * are lost depends on the threads). The sort costs O(C log C) per
+	 * frame in the number of contacts.
+	 */
+	void setDeterministic(bool deterministic);
+	bool isDeterministic() const;
+
+	/**
+	 * Returns the heap allocations made in the given stage of the last
+	 * step, and in the whole of the last step. These are only counted
+	 * when allocation counting is compiled in (see AllocationCounter),
+	 * and include those made by other threads during the stage.
+	 */
+	const AllocationCounts& getStageAllocations(ParticleWorldStage stage) const;
+	AllocationCounts getStepAllocations() const;
+
+	/**
+	 * Returns the figures for the last call to runPhysics.
+	 */
+	const ParticleWorldStats& getStats() const;
+
+	/**
+	 * Returns the time, in nanoseconds, that the given stage took in
+	 * the given percentage of the recent steps (up to STATS_WINDOW of
+	 * them): 50 gives the median, and 99 the time only the slowest 1%
+	 * took longer than. Passing STAGE_COUNT as the stage gives the time
+	 * of the whole step. Returns zero before the first step.
+	 */
+	unsigned long long getStagePercentile(ParticleWorldStage stage, float percentile) const;
+
+	/**
+	 * Returns the arena that this frame's contacts and scratch space
+	 * come from. Contact and force generators can allocate from it
+	 * too, for anything that is not needed after the frame.
+	 */
+	FrameArena& getFrameArena();
+
+	/**
+	 * Returns a hash of the position, velocity and sleep state of every
+	 * particle, in order, for checking that two runs match.
+	 */
+	unsigned long long calculateStateHash() const;
+
+	/**
+	 * Returns the contact resolver, which can be switched to
+	 * sequential impulses.
+	 */
+	ParticleContactResolver& getResolver();
+
+	/**
+	 * Returns the islands the contacts were split into in the last
+	 * call to runPhysics.
+	 */
+	const ParticleIslands& getIslands() const;
+
+	/**
+	 *  Returns the list of particles. As the list may be changed
+	 *  through it, the world checks again whether its particles can
+	 *  be processed as a whole store on the next step, and forgets
+	 *  which particles went to sleep together.
 	 */
 	Particles& getParticles();
 
+	/**
+	 * Returns the force generators that apply to every particle,
+	 * and the registry of those that apply to particular particles.
+	 */
+	ForceGenerators& getForceGenerators();
+	ParticleForceRegistry& getForceRegistry();
+
 	/**
 	 * Returns the list of contact generators.
 	 */
@@ -0,0 +1,306 @@
+#include "BenchScenario.h"
+#include <math.h>
+#include <string.h>
+
+static const char* scenarioNames[SCENARIO_COUNT] = { "gas", "pile", "mix", "stack", "projectiles" };
+
+BenchScenario::BenchScenario(BenchScenarioType type, unsigned numParticles, unsigned seed) :
+	type(type),
+	store(numParticles ? numParticles : 1),
+	particleCollision(0),
+	gravity(Vector2::GRAVITY * 20.0f),
+	drag(50, 0, 0),
+	world(numParticles * 8 + 64),
+	random(seed ? seed : 1)
+{
+	if (numParticles == 0)
+		numParticles = 1;
+
+	//Particles are only ever added up to the reserved count, so pointers to them stay valid
+	particles.reserve(numParticles);
+
+	float halfSize = 0;
+	switch (type)
+	{
+	case SCENARIO_GAS: buildGas(numParticles, halfSize); break;
+	case SCENARIO_PILE: buildPile(numParticles, halfSize); break;
+	case SCENARIO_MIX: buildMix(numParticles, halfSize); break;
+	case SCENARIO_STACK: buildStack(numParticles, halfSize); break;
+	default: buildProjectiles(numParticles, halfSize); break;
+	}
+
+	walls.setBounds(halfSize, halfSize);
+
+	//Particle collisions need the particles in place, so are set up once they have all been added
+	particleCollision = new ParticleCollision((int)particles.size(), particles.data());
+	if (type == SCENARIO_MIX)
+		particleCollision->setBroadphase(&broadphase);
+	if (type == SCENARIO_GAS)
+		particleCollision->setRestitution(1.0f);
+	world.getParticleContactGenerator().push_back(particleCollision);
+
+	for (unsigned i = 0; i < platforms.size(); i++)
+	{
+		for (unsigned j = 0; j < particles.size(); j++)
+			platforms[i]->particle.push_back(&particles[j]);
+
+		world.getPlatformContactGenerators().push_back(platforms[i]);
+	}
+
+	for (unsigned i = 0; i < particles.size(); i++)
+		world.getParticles().push_back(&particles[i]);
+
+	//The gas and the projectiles are in free space; everything else falls as in the blob demo
+	if (type != SCENARIO_GAS && type != SCENARIO_PROJECTILES)
+	{
+		world.getForceGenerators().push_back(&gravity);
+		world.getForceGenerators().push_back(&drag);
+	}
+
+	world.getResolver().setSequentialImpulses(true, 6);
+	world.setSleeping(type != SCENARIO_GAS);
+}
+
+BenchScenario::~BenchScenario()
+{
+	for (unsigned i = 0; i < platforms.size(); i++)
+		delete platforms[i];
+
+	delete particleCollision;
+}
+
+void BenchScenario::step(float duration)
+{
+	world.runPhysics(duration);
+	walls.resolve(particles.data(), (unsigned)particles.size());
+}
+
+const char* BenchScenario::getName(BenchScenarioType type)
+{
+	return type < SCENARIO_COUNT ? scenarioNames[type] : "unknown";
+}
+
+bool BenchScenario::findType(const char* name, BenchScenarioType& type)
+{
+	for (int i = 0; i < SCENARIO_COUNT; i++)
+	{
+		if (strcmp(name, scenarioNames[i]) == 0)
+		{
+			type = (BenchScenarioType)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float BenchScenario::randomFloat(float min, float max)
+{
+	//xorshift32, so that a seed gives the same scene on every platform
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+
+	return min + (max - min) * (random >> 8) * (1.0f / 16777216.0f);
+}
+
+Particle& BenchScenario::addSphere(float x, float y, float radius, float mass)
+{
+	particles.emplace_back(store);
+
+	Particle& particle = particles.back();
+	particle.setPosition(x, y);
+	particle.setRadius(radius);
+	particle.setMass(mass);
+	particle.setVelocity(0, 0);
+	particle.clearAccumulator();
+
+	return particle;
+}
+
+Particle& BenchScenario::addPolygon(float x, float y, float radius, float mass, bool quad)
+{
+	Particle& particle = addSphere(x, y, radius, mass);
+
+	//The same shapes as the blob demo's quads and triangles
+	std::vector<Vector2> vertices;
+	if (quad)
+	{
+		vertices.push_back(Vector2(1, 1).unit() * radius);
+		vertices.push_back(Vector2(1, -1).unit() * radius);
+		vertices.push_back(Vector2(-1, -1).unit() * radius);
+		vertices.push_back(Vector2(-1, 1).unit() * radius);
+		particle.setVertices(vertices);
+		particle.setWidthAndHeight(vertices[0].x - vertices[3].x, vertices[0].y - vertices[1].y);
+	}
+	else
+	{
+		vertices.push_back(Vector2(0, 1).unit() * radius);
+		vertices.push_back(Vector2(1.1f, -0.9f).unit() * radius);
+		vertices.push_back(Vector2(-1.1f, -0.9f).unit() * radius);
+		particle.setVertices(vertices);
+		particle.setWidthAndHeight(vertices[1].x - vertices[2].x, vertices[0].y - vertices[1].y);
+	}
+
+	return particle;
+}
+
+void BenchScenario::addPlatform(const Vector2& start, const Vector2& end, float restitution)
+{
+	Platform* platform = new Platform;
+	platform->id = (unsigned)platforms.size();
+	platform->start = start;
+	platform->end = end;
+	platform->setRestitution(restitution);
+
+	platforms.push_back(platform);
+}
+
+void BenchScenario::buildGas(unsigned count, float& halfSize)
+{
+	//About one particle in each 15 x 15 square, so contacts are rare
+	const float spacing = 15.0f;
+	unsigned columns = (unsigned)ceil(sqrt((double)count));
+	halfSize = columns * spacing * 0.5f;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		float radius = randomFloat(1.5f, 2.5f);
+		float x = randomFloat(-halfSize + radius, halfSize - radius);
+		float y = randomFloat(-halfSize + radius, halfSize - radius);
+
+		Particle& particle = addSphere(x, y, radius, radius * 2.0f);
+		particle.setVelocity(randomFloat(-40.0f, 40.0f), randomFloat(-40.0f, 40.0f));
+	}
+}
+
+void BenchScenario::buildPile(unsigned count, float& halfSize)
+{
+	//Rows of spheres, each sitting in the gaps of the one below, on a floor between two slopes, so
+	//the pile is dense from the first step
+	const float spacing = 6.0f;
+	const float rowSpacing = 5.2f;
+	unsigned columns = (unsigned)ceil(sqrt(2.0 * count));
+	float width = columns * spacing;
+	halfSize = width * 0.5f + 40.0f;
+
+	float floor = -halfSize + 10.0f;
+	addPlatform(Vector2(-halfSize, floor + 40.0f), Vector2(-width * 0.5f, floor), 0.3f);
+	addPlatform(Vector2(width * 0.5f, floor), Vector2(halfSize, floor + 40.0f), 0.3f);
+	addPlatform(Vector2(-halfSize, floor), Vector2(halfSize, floor), 0.3f);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		unsigned row = i / columns;
+		float x = -width * 0.5f + spacing * (0.5f + i % columns) + ((row & 1) ? 0.5f * spacing : 0.0f);
+		float y = floor + 3.0f + rowSpacing * row;
+
+		addSphere(x, y, randomFloat(2.6f, 3.0f), randomFloat(4.0f, 6.0f));
+	}
+}
+
+void BenchScenario::buildMix(unsigned count, float& halfSize)
+{
+	//Laid out like the blob demo: in each twelve particles, ten spheres of growing size, a quad and a triangle
+	const float spacing = 30.0f;
+	unsigned columns = (unsigned)ceil(sqrt(2.0 * count));
+	float width = columns * spacing;
+	halfSize = width * 0.5f + 40.0f;
+
+	//Rows of the demo's sloping platform in the lower half of the box. Each platform tests every
+	//particle, so there are only a few of them however many particles there are.
+	unsigned numPlatforms = 1 + count / 100;
+	if (numPlatforms > 8)
+		numPlatforms = 8;
+
+	unsigned perRow = (numPlatforms + 1) / 2;
+	float slot = 2.0f * halfSize / perRow;
+	for (unsigned i = 0; i < numPlatforms; i++)
+	{
+		float left = -halfSize + slot * (i % perRow) + ((i / perRow) ? 0.5f * slot : 0.0f);
+		float right = left + 0.8f * slot;
+		if (right > halfSize)
+			right = halfSize;
+
+		float y = (i / perRow) ? -0.7f * halfSize : -0.35f * halfSize;
+		addPlatform(Vector2(left, y + 0.05f * slot), Vector2(right, y), 0.6f);
+	}
+
+	//Starting just above the upper platforms, so that the particles are soon among them
+	for (unsigned i = 0; i < count; i++)
+	{
+		float x = -width * 0.5f + spacing * (0.5f + i % columns);
+		float y = -0.35f * halfSize + 0.05f * slot + 25.0f + spacing * (0.5f + i / columns);
+		unsigned kind = i % 12;
+
+		if (kind < 10)
+		{
+			Particle& particle = addSphere(x, y, 5.0f + kind, 5.0f + kind);
+			particle.setVelocity(10, -1);
+		}
+		else if (kind == 10)
+		{
+			Particle& particle = addPolygon(x, y, 20.0f, 20.0f, true);
+			particle.setVelocity(-10, -2);
+		}
+		else
+		{
+			Particle& particle = addPolygon(x, y, 20.0f, 15.0f, false);
+			particle.setVelocity(0, -2);
+		}
+	}
+}
+
+void BenchScenario::buildStack(unsigned count, float& halfSize)
+{
+	//Square-ish columns of spheres, each resting on the one below
+	const float radius = 3.0f;
+	const float columnSpacing = 7.0f;
+	unsigned columns = (unsigned)ceil(sqrt((double)count));
+	unsigned rows = (count + columns - 1) / columns;
+
+	float halfWidth = columns * columnSpacing * 0.5f;
+	float halfHeight = rows * radius;
+	halfSize = (halfWidth > halfHeight ? halfWidth : halfHeight) + 20.0f;
+
+	float floor = -halfSize + 10.0f;
+	addPlatform(Vector2(-halfSize, floor), Vector2(halfSize, floor), 0.0f);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		float x = -halfWidth + columnSpacing * (0.5f + i % columns);
+		float y = floor + radius * (1.0f + 2.0f * (i / columns));
+
+		addSphere(x, y, radius, 5.0f);
+	}
+}
+
+void BenchScenario::buildProjectiles(unsigned count, float& halfSize)
+{
+	//One particle in ten is a projectile, crossing several target spacings in each step of the demo
+	unsigned numProjectiles = count / 10 ? count / 10 : 1;
+	unsigned numTargets = count - numProjectiles;
+
+	const float spacing = 10.0f;
+	unsigned columns = (unsigned)ceil(sqrt((double)(numTargets ? numTargets : 1)));
+	float width = columns * spacing;
+	halfSize = width * 0.5f + 40.0f;
+
+	for (unsigned i = 0; i < numTargets; i++)
+	{
+		float x = -width * 0.5f + spacing * (0.5f + i % columns);
+		float y = -width * 0.5f + spacing * (0.5f + i / columns);
+
+		addSphere(x, y, 2.0f, 5.0f);
+	}
+
+	//Fired from the strip between the left wall and the targets
+	for (unsigned i = 0; i < numProjectiles; i++)
+	{
+		float x = randomFloat(-halfSize + 2.0f, -halfSize + 38.0f);
+		float y = randomFloat(-halfSize + 2.0f, halfSize - 2.0f);
+
+		Particle& particle = addSphere(x, y, 1.5f, 2.0f);
+		particle.setVelocity(1500.0f, randomFloat(-100.0f, 100.0f));
+	}
+}
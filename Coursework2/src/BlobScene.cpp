@@ -0,0 +1,150 @@
+#include "BlobScene.h"
+
+BlobScene::BlobScene() :
+	gravity(Vector2::GRAVITY * 20.0f),
+	drag(50, 0, 0),
+	world((NUM_PARTICLES + NUM_PLATFORMS) * (NUM_PARTICLES + NUM_PLATFORMS - 1), NUM_PLATFORMS * 5)
+{
+	// Create the blob storage
+	blob = new Particle[NUM_PARTICLES];
+
+	//Create a new particle collision object, and tell it how many other particles there are to watch for collisions with.
+	//Also, give it a pointer to the array of particles, and a pointer to the specific particle it is associated with
+	particleCollision = new ParticleCollision(NUM_PARTICLES, blob);
+	particleCollision->setBroadphase(&broadphase);
+
+	// Create the platform
+	platform[0] = new Platform;
+	platform[0]->id = 0;
+	platform[0]->setRestitution(0.6);
+	platform[0]->start = Vector2(-50.0, 10.0);
+	platform[0]->end = Vector2(45.0, 5.0);
+
+	// Make sure the platform knows which particle it should collide with.
+	for (int i = 0; i < NUM_PLATFORMS; i++)
+		for (int j = 0; j < NUM_PARTICLES; j++)
+			platform[i]->particle.push_back(blob + j);
+
+	//Add platforms to world object's vector of platform contact generators
+	for (int i = 0; i < NUM_PLATFORMS; i++)
+		world.getPlatformContactGenerators().push_back(platform[i]);
+
+	//Add particle collision object to world object's vector of particle contact generators
+	world.getParticleContactGenerator().push_back(particleCollision);
+
+	//Gravity and drag act on every particle
+	world.getForceGenerators().push_back(&gravity);
+	world.getForceGenerators().push_back(&drag);
+
+	//Resolve contacts with sequential impulses, which lets piles of particles come to rest
+	world.getResolver().setSequentialImpulses(true, 6);
+
+	//Let particles that have come to rest sleep until something disturbs them
+	world.setSleeping(true);
+
+	// Initialise sphere particles
+	for (int i = 0; i < NUM_SPHERES; i++)
+	{
+		(blob + i)->setPosition(i * 10, 80);
+		(blob + i)->setRadius(BASE_SPHERE_RADIUS + (i % 10));
+		(blob + i)->setMass(BASE_SPHERE_MASS + (i % 10));
+		(blob + i)->setVelocity(10, -1);
+		(blob + i)->clearAccumulator();
+
+		world.getParticles().push_back(blob + i);
+	}
+
+	//Initialise quad particles
+	for (int i = NUM_SPHERES; i < NUM_SPHERES + NUM_QUADS; i++)
+	{
+		(blob + i)->setPosition(i * 10, 80);
+		(blob + i)->setRadius(20);
+		(blob + i)->setMass(20);
+		(blob + i)->setVelocity(-10, -2);
+		(blob + i)->clearAccumulator();
+
+		float radius = (blob + i)->getRadius();
+
+		//Set up vertices for non-sphere particles
+		std::vector<Vector2> vertices = {
+			Vector2(1, 1).unit() * radius,
+			Vector2(1, -1).unit() * radius,
+			Vector2(-1, -1).unit() * radius,
+			Vector2(-1, 1).unit() * radius
+		};
+
+		(blob + i)->setVertices(vertices);
+
+		float width = vertices[0].x - vertices[3].x;
+		float height = vertices[0].y - vertices[1].y;
+
+		(blob + i)->setWidthAndHeight(width, height);
+
+		world.getParticles().push_back(blob + i);
+	}
+
+	//Initialise triangle particles
+	for (int i = NUM_SPHERES + NUM_QUADS; i < NUM_PARTICLES; i++)
+	{
+		(blob + i)->setPosition(i * 10, 80);
+		(blob + i)->setRadius(20);
+		(blob + i)->setMass(15);
+		(blob + i)->setVelocity(0, -2);
+		(blob + i)->clearAccumulator();
+
+		float radius = (blob + i)->getRadius();
+
+		//Set up vertices for non-sphere particles
+		std::vector<Vector2> vertices = {
+			Vector2(0, 1).unit() * radius,
+			Vector2(1.1, -0.9).unit() * radius,
+			Vector2(-1.1, -0.9).unit() * radius
+		};
+
+		(blob + i)->setVertices(vertices);
+
+		float width = vertices[1].x - vertices[2].x;
+		float height = vertices[0].y - vertices[1].y;
+
+		(blob + i)->setWidthAndHeight(width, height);
+
+		world.getParticles().push_back(blob + i);
+	}
+
+	for (int i = 0; i < NUM_PARTICLES; i++)
+		previousPosition[i] = (blob + i)->getPosition();
+}
+
+BlobScene::~BlobScene()
+{
+	for (int i = 0; i < NUM_PLATFORMS; i++)
+		delete platform[i];
+
+	delete particleCollision;
+
+	// Release the blob storage
+	delete[] blob;
+}
+
+void BlobScene::step(float duration)
+{
+	// Run the simulation
+	world.runPhysics(duration);
+
+	//Boundary collision detection and resolution
+	walls.resolve(blob, NUM_PARTICLES);
+}
+
+void BlobScene::fixedStep(float duration, unsigned substeps)
+{
+	for (int i = 0; i < NUM_PARTICLES; i++)
+		previousPosition[i] = (blob + i)->getPosition();
+
+	for (unsigned i = 0; i < substeps; i++)
+		step(duration / substeps);
+}
+
+Vector2 BlobScene::getRenderPosition(int index, float alpha) const
+{
+	return previousPosition[index] * (1.0f - alpha) + (blob + index)->getPosition() * alpha;
+}
@@ -1,162 +1,199 @@
+#include <math.h>
 #include "pcontacts.h"
 #include "ParticleCollision.h"
-#include <gl/glut.h>
+#include "pjobs.h"
+#include "ptrace.h"
 
 using namespace std;
 
+//The number of pairs each thread tests at a time
+static const unsigned NARROWPHASE_GRAIN = 128;
+
 ParticleCollision::ParticleCollision(int numParticles, Particle* arrayPtr) : NUM_PARTICLES(numParticles)
 {
 	particles = arrayPtr;
+	broadphase = &defaultBroadphase;
+	jobs = NULL;
+}
+
+void ParticleCollision::setBroadphase(ParticleBroadphase* broadphase)
+{
+	this->broadphase = broadphase;
+
+	if (broadphase)
+		broadphase->setJobSystem(jobs);
+}
+
+void ParticleCollision::setJobSystem(JobSystem* jobs)
+{
+	this->jobs = jobs;
+
+	if (broadphase)
+		broadphase->setJobSystem(jobs);
+}
+
+void ParticleCollision::generateRange(void* context, unsigned begin, unsigned end, unsigned thread)
+{
+	ParticleCollision* collision = (ParticleCollision*)context;
+	const vector<ParticlePair>& pairs = collision->broadphase->getPairs();
+	vector<ParticleContact>& found = collision->threadContacts[thread];
+
+	ParticleContact contact;
+
+	for (unsigned p = begin; p < end; p++)
+		if (collision->generateContact(pairs[p].first, pairs[p].second, &contact))
+			found.push_back(contact);
 }
 
 unsigned ParticleCollision::addContact(ParticleContact *contact, unsigned limit)
 {
+	PTRACE_ZONE("ParticleCollision::addContact");
+
 	//const static float restitution = 1.0f;
 	unsigned used = 0;
+	ParticleContact found;
+
+	//The contacts there is no room for are kept, so the world can make room and collect them
+	//without the broadphase and narrowphase being run again
+	dropped.clear();
 
-	for (int i = 0; i < NUM_PARTICLES; i++)
+	//Without a broadphase, every particle is tested against every other particle
+	if (!broadphase)
 	{
-		Vector2 pos1 = particles[i].getPosition();
-		float radius1 = particles[i].getRadius();
-		Vector2 velocity1 = particles[i].getVelocity();
-		float mass1 = particles[i].getMass();
-
-		for (int j = 0; j < NUM_PARTICLES; j++)
-		{
-			//Particle cannot collide with itself
-			if (i == j)
-				continue;
-
-			Vector2 pos2 = (particles[j]).getPosition();
-			Vector2 velocity2 = (particles[j]).getVelocity();
-			float radius2 = (particles[j]).getRadius();
-			float mass2 = (particles[j]).getMass();
-
-			//Distance from sphere 2 to sphere 1
-			Vector2 sphereDistanceVec = pos1 - pos2;
-			float distance = sphereDistanceVec.magnitude();
-
-			if (checkCollision(particles[i], particles[j], distance))
-			{
-				// We have a collision
-				contact->contactNormal = sphereDistanceVec.unit();
-				contact->restitution = restitution;
-				contact->particle[0] = &particles[i];
-				contact->particle[1] = &particles[j];
-
-				if (particles[i].isSphere() && particles[j].isSphere())
-					contact->penetration = (radius1 + radius2) - distance;
-				else if (!particles[i].isSphere() || !particles[j].isSphere())
-				{
-					Vector2 closestPoint = MDVertices[0];
-					float interPenetrationDist = 100;
-
-					//Find closest point of Minkowski difference to origin and calculate inter-penetration from it
-					for (int i = 1; i < MDVertices.size(); i++)
-					{
-						float temp = (Vector2(0, 0) - MDVertices[i]).magnitude();
-
-						if (temp < interPenetrationDist)
-							interPenetrationDist = temp;
-					}
-
-					contact->penetration = interPenetrationDist;
-				}
-
-				used++;
-				contact++;
-			}
-		}
-	}
+		//Each unordered pair is only tested once, with the lower index first
+		for (int i = 0; i < NUM_PARTICLES; i++)
+			for (int j = i + 1; j < NUM_PARTICLES; j++)
+				if (generateContact(i, j, &found))
+					addFound(found, contact, used, limit);
 
-	return used;
-}
+		return used;
+	}
 
-bool ParticleCollision::checkCollision(Particle& particle1, Particle& particle2, float distance)
-{
-	//Simple check for collision between two spheres
-	if (particle1.isSphere() && particle2.isSphere())
+	//Otherwise only the pairs whose bounding boxes overlap are tested
 	{
-		//If length of sphereDistanceVec <= (radius1 + radius2), then spheres have collided or inter-penetrated
-		if (distance <= particle1.getRadius() + particle2.getRadius())
-			return true;
-		else
-			return false;
+		PTRACE_ZONE("broadphase update");
+		broadphase->update(particles, NUM_PARTICLES);
 	}
-	//One of the shapes is a convex polygon, so check for collision using Minkowski difference
-	else
+	const vector<ParticlePair>& pairs = broadphase->getPairs();
+
+	if (jobs && jobs->getThreadCount() > 1)
 	{
-		//Calculate vertices of Minkowski difference between two particles
-		MDVertices = calcMinkowskiDifferenceVertices(particle1, particle2);
+		threadContacts.resize(jobs->getThreadCount());
+		for (unsigned t = 0; t < threadContacts.size(); t++)
+			threadContacts[t].clear();
+
+		jobs->parallelFor(pairs.size(), NARROWPHASE_GRAIN, generateRange, this);
+
+		//Each thread kept its own contacts, so they only need copying out
+		for (unsigned t = 0; t < threadContacts.size(); t++)
+			for (unsigned c = 0; c < threadContacts[t].size(); c++)
+				addFound(threadContacts[t][c], contact, used, limit);
 
-		//Check if Minkowski difference contains the origin or not
-		bool collision = polygonContainsOrigin(MDVertices);
-		
-		return collision;
+		return used;
 	}
+
+	for (unsigned p = 0; p < pairs.size(); p++)
+		if (generateContact(pairs[p].first, pairs[p].second, &found))
+			addFound(found, contact, used, limit);
+
+	return used;
 }
 
-/*
-Code used in this function to detect whether the Minkowski difference contains origin is based on
-code written by W Randolph Franklin. See https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html.
-Method is based on projecting a ray through the polygon from the origin and working out
-whether it is inside or outside the polygon by the number of edges it intersects.
-*/
-bool ParticleCollision::polygonContainsOrigin(vector<Vector2>& vertices)
+void ParticleCollision::addFound(const ParticleContact& found, ParticleContact *contact, unsigned& used, unsigned limit)
 {
-	bool collision = false;
-	
-	for (int i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++)
-	{
-		if (((vertices[i].y>0) != (vertices[j].y>0)) &&
-			(0 < (vertices[j].x - vertices[i].x) * (0 - vertices[i].y) / (vertices[j].y - vertices[i].y) + vertices[i].x))
-			collision = !collision;
-	}
-
-	return collision;
+	if (used < limit)
+		contact[used++] = found;
+	else
+		dropped.add(found);
 }
 
-vector<Vector2> ParticleCollision::calcMinkowskiDifferenceVertices(Particle& particle1, Particle& particle2)
+//Returns true if the particle can be moved by a contact right now
+static bool isActive(const Particle& particle)
 {
-	vector<Vector2> particle1Vertices;
-	vector<Vector2> particle2Vertices;
-	vector<Vector2> minkowskiDiffVertices;
+	return particle.isAwake() && particle.getInverseMass() > 0;
+}
 
-	//Populate particle1Vertices vector. If particle1 == sphere, estimate vertices. Else, retrieve particle1's stored vertices
-	if (particle1.isSphere())
-		particle1Vertices = estimateSphereVertices(particle1);
-	else
-		particle1Vertices = particle1.getVertices();
+bool ParticleCollision::generateContact(int i, int j, ParticleContact *contact)
+{
+	Vector2 normal;
+	float penetration;
+
+	//There is nothing to resolve between particles that are asleep or cannot move
+	if (!isActive(particles[i]) && !isActive(particles[j]))
+		return false;
+
+	if (!collide(particles[i], particles[j], (particles[i].getPosition() - particles[j].getPosition()).squareMagnitude(),
+		normal, penetration))
+		return false;
+
+	// We have a collision
+	contact->contactNormal = normal;
+	contact->restitution = restitution;
+	contact->particle[0] = &particles[i];
+	contact->particle[1] = &particles[j];
+	contact->pairId = ParticleContact::makePairId(i, j);
+	contact->penetration = penetration;
+
+	return true;
+}
 
-	//Populate particle2Vertices vector. If particle2 == sphere, estimate vertices. Else, retrieve particle2's stored vertices
-	if (particle2.isSphere())
-		particle2Vertices = estimateSphereVertices(particle2);
-	else
-		particle2Vertices = particle2.getVertices();
+bool ParticleCollision::checkCollision(Particle& particle1, Particle& particle2, float distance)
+{
+	Vector2 normal;
+	float penetration;
 
-	//Populate vector of Minkowski difference vertices with particle 1 vertices - particle 2 vertices
-	for (int i = 0; i < particle1Vertices.size(); i++)
-		for (int j = 0; j < particle2Vertices.size(); j++)
-			minkowskiDiffVertices.push_back((particle1Vertices[i] + particle1.getPosition()) - (particle2Vertices[j] + particle2.getPosition()));
+	return collide(particle1, particle2, distance * distance, normal, penetration);
+}
 
-	return minkowskiDiffVertices;
+bool ParticleCollision::checkCollision(Particle& particle1, Particle& particle2, float distance, Vector2& normal, float& penetration)
+{
+	return collide(particle1, particle2, distance * distance, normal, penetration);
 }
 
-//calculate 8 of the vertices of a sphere particle (cannot calculate all, since a circle has infinite vertices)
-vector<Vector2> ParticleCollision::estimateSphereVertices(Particle& particle) const
+bool ParticleCollision::collide(Particle& particle1, Particle& particle2, float squareDistance, Vector2& normal, float& penetration)
 {
-	vector<Vector2> vertices;
-	float radius = particle.getRadius();
+	//Particles further apart than their bounding circles reach cannot be touching
+	float reach = particle1.getBoundingRadius() + particle2.getBoundingRadius();
 
-	vertices.push_back(Vector2(-radius, 0));
-	vertices.push_back(Vector2(radius, 0));
-	vertices.push_back(Vector2(0, -radius));
-	vertices.push_back(Vector2(0, -radius));
+	if (squareDistance > reach * reach)
+		return false;
 
-	vertices.push_back(Vector2(1, 1).unit() * radius);
-	vertices.push_back(Vector2(-1, 1).unit() * radius);
-	vertices.push_back(Vector2(-1, -1).unit() * radius);
-	vertices.push_back(Vector2(1, -1).unit() * radius);
+	//For two spheres the bounding circles are the shapes, so they are touching
+	if (particle1.isSphere() && particle2.isSphere())
+	{
+		float distance = sqrt(squareDistance);
+
+		normal = (particle1.getPosition() - particle2.getPosition()).unit();
+		penetration = reach - distance;
+		return true;
+	}
+
+	//Bounding boxes fit polygons more tightly than circles do
+	Vector2 min1, max1, min2, max2;
+	particle1.getBounds(min1, max1);
+	particle2.getBounds(min2, max2);
+
+	if (max1.x < min2.x || max2.x < min1.x || max1.y < min2.y || max2.y < min1.y)
+		return false;
+
+	ConvexShape shape1, shape2;
+	shape1.setParticle(particle1);
+	shape2.setParticle(particle2);
+
+	//A sphere and a polygon can be tested exactly against the polygon's closest feature
+	if (particle1.isSphere())
+		return ConvexCollision::circlePolygon(shape1.position, shape1.radius, shape2, normal, penetration);
 
-	return vertices;
-}
\ No newline at end of file
+	if (particle2.isSphere())
+	{
+		if (!ConvexCollision::circlePolygon(shape2.position, shape2.radius, shape1, normal, penetration))
+			return false;
+
+		//The normal says which way the sphere should move, so particle1 goes the other way
+		normal.invert();
+		return true;
+	}
+
+	//Both shapes are convex polygons, so check for collision using GJK, and find the penetration using EPA
+	return ConvexCollision::intersect(shape1, shape2, normal, penetration);
+}
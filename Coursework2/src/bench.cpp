@@ -0,0 +1,540 @@
+/*
+ * Measures how runPhysics scales with the number of particles and
+ * threads, over a set of generated scenes, and writes the results as
+ * JSON. Given a baseline written by an earlier run, it also flags the
+ * runs that have got slower.
+ *
+ */
+#include "BenchScenario.h"
+#include "pjobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+static const char* stageNames[STAGE_COUNT] = {
+	"forces", "integrate", "particle_contacts", "platform_contacts", "resolve"
+};
+
+//The settings of a whole benchmark run
+struct BenchOptions
+{
+	std::vector<BenchScenarioType> scenarios;
+	std::vector<unsigned> counts;
+	std::vector<unsigned> threads;
+	unsigned warmup;
+	unsigned minFrames;
+	unsigned maxFrames;
+	double minSeconds;
+	float duration;
+	unsigned seed;
+	bool deterministic;
+	const char* outputFile;
+	const char* baselineFile;
+	double threshold;
+};
+
+//The figures measured for one scenario, particle count and thread count
+struct BenchResult
+{
+	BenchScenarioType scenario;
+	unsigned particles;
+	unsigned threads;
+	unsigned frames;
+	double setupSeconds;
+	double stepsPerSecond;
+
+	//Mean, median and 99th percentile time of each stage, in nanoseconds, with the whole step last
+	double mean[STAGE_COUNT + 1];
+	unsigned long long p50[STAGE_COUNT + 1];
+	unsigned long long p99[STAGE_COUNT + 1];
+
+	double meanContacts;
+	unsigned maxContacts;
+	unsigned contactCapacity;
+	unsigned long long arenaBytes;
+
+	//The memory the whole process had resident at the end of the run. This includes whatever the
+	//runs before it left behind, so it is only an upper bound on what this run needed.
+	unsigned long long processResidentBytes;
+	double allocationsPerStep;
+};
+
+//Returns the memory the process has resident, or zero where this is not known
+static unsigned long long getResidentBytes()
+{
+#if defined(__linux__)
+	unsigned long long pages = 0, resident = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file)
+	{
+		if (fscanf(file, "%llu %llu", &pages, &resident) != 2)
+			resident = 0;
+		fclose(file);
+	}
+	return resident * (unsigned long long)sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+static unsigned getMaxThreads()
+{
+	unsigned threads = std::thread::hardware_concurrency();
+	return threads ? threads : 1;
+}
+
+//Parses a comma separated list of numbers into values. "max" stands for the number of hardware threads.
+static bool parseList(const char* text, std::vector<unsigned>& values)
+{
+	values.clear();
+
+	while (*text)
+	{
+		char* end;
+		unsigned long value;
+
+		if (strncmp(text, "max", 3) == 0)
+		{
+			value = getMaxThreads();
+			end = (char*)text + 3;
+		}
+		else
+		{
+			value = strtoul(text, &end, 10);
+			if (end == text)
+				return false;
+		}
+
+		//Allow the usual shorthand for large counts
+		if (*end == 'k' || *end == 'K') { value *= 1000; end++; }
+		else if (*end == 'm' || *end == 'M') { value *= 1000000; end++; }
+
+		if (value == 0)
+			return false;
+		values.push_back((unsigned)value);
+
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return false;
+		text = end;
+	}
+
+	return !values.empty();
+}
+
+static bool parseScenarios(const char* text, std::vector<BenchScenarioType>& scenarios)
+{
+	scenarios.clear();
+
+	std::string list(text);
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.size();
+
+		std::string name = list.substr(start, end - start);
+		BenchScenarioType type;
+
+		if (name == "all")
+		{
+			for (int i = 0; i < SCENARIO_COUNT; i++)
+				scenarios.push_back((BenchScenarioType)i);
+		}
+		else if (BenchScenario::findType(name.c_str(), type))
+			scenarios.push_back(type);
+		else
+			return false;
+
+		start = end + 1;
+	}
+
+	return !scenarios.empty();
+}
+
+static double getSeconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Returns the smallest time that at least the given percentage of the times were no slower than,
+//taken the same way as ParticleWorld::getStagePercentile. Reorders the times.
+static unsigned long long getPercentile(std::vector<unsigned long long>& times, float percentile)
+{
+	if (times.empty())
+		return 0;
+
+	float rank = percentile / 100.0f * times.size();
+	size_t index = rank > 1 ? (size_t)ceilf(rank) - 1 : 0;
+	if (index >= times.size())
+		index = times.size() - 1;
+
+	std::nth_element(times.begin(), times.begin() + index, times.end());
+	return times[index];
+}
+
+//Builds one scene and times its steps
+static BenchResult runBenchmark(const BenchOptions& options, BenchScenarioType type, unsigned count, JobSystem* jobs)
+{
+	BenchResult result;
+	memset(&result, 0, sizeof(result));
+	result.scenario = type;
+	result.particles = count;
+	result.threads = jobs ? jobs->getThreadCount() : 1;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	BenchScenario scenario(type, count, options.seed);
+	ParticleWorld& world = scenario.getWorld();
+	world.setJobSystem(jobs);
+	world.setDeterministic(options.deterministic);
+	result.setupSeconds = getSeconds(start);
+
+	//Let the scene settle and the world's buffers reach their working size before timing anything
+	for (unsigned i = 0; i < options.warmup; i++)
+		scenario.step(options.duration);
+
+	//The world's own percentiles cover its recent history, which would include the warm-up, so the
+	//timed steps are kept here
+	double stageSums[STAGE_COUNT + 1] = { 0 };
+	std::vector<unsigned long long> stageTimes[STAGE_COUNT + 1];
+	unsigned long long contactSum = 0;
+	unsigned long long allocations = 0;
+
+	start = std::chrono::steady_clock::now();
+	double seconds = 0;
+
+	while (result.frames < options.maxFrames && (result.frames < options.minFrames || seconds < options.minSeconds))
+	{
+		scenario.step(options.duration);
+		result.frames++;
+
+		const ParticleWorldStats& stats = world.getStats();
+		unsigned long long stepTime = 0;
+		for (int stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			stageSums[stage] += (double)stats.stageTime[stage];
+			stageTimes[stage].push_back(stats.stageTime[stage]);
+			stepTime += stats.stageTime[stage];
+		}
+		stageSums[STAGE_COUNT] += (double)stepTime;
+		stageTimes[STAGE_COUNT].push_back(stepTime);
+
+		contactSum += stats.contacts;
+		if (stats.contacts > result.maxContacts)
+			result.maxContacts = stats.contacts;
+		allocations += world.getStepAllocations().allocations;
+
+		seconds = getSeconds(start);
+	}
+
+	result.stepsPerSecond = seconds > 0 ? result.frames / seconds : 0;
+
+	for (int stage = 0; stage <= STAGE_COUNT; stage++)
+	{
+		result.mean[stage] = result.frames ? stageSums[stage] / result.frames : 0;
+		result.p50[stage] = getPercentile(stageTimes[stage], 50);
+		result.p99[stage] = getPercentile(stageTimes[stage], 99);
+	}
+
+	result.meanContacts = result.frames ? (double)contactSum / result.frames : 0;
+	result.contactCapacity = world.getContactCapacity();
+	result.arenaBytes = world.getFrameArena().getHighWater();
+	result.processResidentBytes = getResidentBytes();
+	result.allocationsPerStep = result.frames ? (double)allocations / result.frames : 0;
+
+	world.setJobSystem(0);
+	return result;
+}
+
+//Writes one result as a single line of JSON, so that compare mode can read it back a line at a time
+static void writeResult(FILE* file, const BenchResult& result, bool last)
+{
+	fprintf(file, "    {\"scenario\": \"%s\", \"particles\": %u, \"threads\": %u, \"frames\": %u, "
+		"\"setup_seconds\": %.6f, \"steps_per_sec\": %.3f, \"stage_ns\": {",
+		BenchScenario::getName(result.scenario), result.particles, result.threads, result.frames,
+		result.setupSeconds, result.stepsPerSecond);
+
+	for (int stage = 0; stage <= STAGE_COUNT; stage++)
+	{
+		fprintf(file, "%s\"%s\": {\"mean\": %.1f, \"p50\": %llu, \"p99\": %llu}",
+			stage ? ", " : "", stage < STAGE_COUNT ? stageNames[stage] : "step",
+			result.mean[stage], result.p50[stage], result.p99[stage]);
+	}
+
+	fprintf(file, "}, \"contacts\": {\"mean\": %.1f, \"max\": %u}, "
+		"\"memory\": {\"contact_capacity\": %u, \"arena_bytes\": %llu, \"process_resident_bytes\": %llu}, "
+		"\"allocations_per_step\": %.3f}%s\n",
+		result.meanContacts, result.maxContacts, result.contactCapacity, result.arenaBytes,
+		result.processResidentBytes, result.allocationsPerStep, last ? "" : ",");
+}
+
+static void writeResults(FILE* file, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+	fprintf(file, "{\n  \"version\": 1,\n");
+	fprintf(file, "  \"settings\": {\"dt\": %g, \"warmup\": %u, \"min_frames\": %u, \"max_frames\": %u, "
+		"\"min_seconds\": %g, \"seed\": %u, \"deterministic\": %s, \"counting_allocations\": %s, \"hardware_threads\": %u},\n",
+		options.duration, options.warmup, options.minFrames, options.maxFrames, options.minSeconds, options.seed,
+		options.deterministic ? "true" : "false", AllocationCounter::isEnabled() ? "true" : "false", getMaxThreads());
+	fprintf(file, "  \"results\": [\n");
+
+	for (unsigned i = 0; i < results.size(); i++)
+		writeResult(file, results[i], i + 1 == results.size());
+
+	fprintf(file, "  ]\n}\n");
+}
+
+//Finds "key": in the line and reads the number or string after it. Only has to cope with files this program wrote.
+static bool readNumber(const char* line, const char* key, double& value)
+{
+	std::string pattern = std::string("\"") + key + "\": ";
+	const char* found = strstr(line, pattern.c_str());
+	if (!found)
+		return false;
+
+	char* end;
+	value = strtod(found + pattern.size(), &end);
+	return end != found + pattern.size();
+}
+
+static bool readString(const char* line, const char* key, std::string& value)
+{
+	std::string pattern = std::string("\"") + key + "\": \"";
+	const char* found = strstr(line, pattern.c_str());
+	if (!found)
+		return false;
+
+	const char* start = found + pattern.size();
+	const char* end = strchr(start, '"');
+	if (!end)
+		return false;
+
+	value.assign(start, end);
+	return true;
+}
+
+//Compares the results with those in the baseline, and returns the number that have slowed down by more than the threshold
+static int compareResults(const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+	FILE* file = fopen(options.baselineFile, "r");
+	if (!file)
+	{
+		fprintf(stderr, "Could not open baseline %s\n", options.baselineFile);
+		return -1;
+	}
+
+	struct BaselineEntry
+	{
+		std::string scenario;
+		unsigned particles;
+		unsigned threads;
+		double stepsPerSecond;
+	};
+	std::vector<BaselineEntry> baseline;
+
+	char line[4096];
+	while (fgets(line, sizeof(line), file))
+	{
+		BaselineEntry entry;
+		double particles, threads;
+
+		if (!readString(line, "scenario", entry.scenario) ||
+			!readNumber(line, "particles", particles) ||
+			!readNumber(line, "threads", threads) ||
+			!readNumber(line, "steps_per_sec", entry.stepsPerSecond))
+			continue;
+
+		entry.particles = (unsigned)particles;
+		entry.threads = (unsigned)threads;
+		baseline.push_back(entry);
+	}
+	fclose(file);
+
+	int regressions = 0;
+	unsigned matched = 0;
+
+	fprintf(stderr, "\n%-12s %9s %7s %14s %14s %8s\n", "scenario", "particles", "threads", "baseline/s", "current/s", "change");
+
+	for (unsigned i = 0; i < results.size(); i++)
+	{
+		const BenchResult& result = results[i];
+		const char* name = BenchScenario::getName(result.scenario);
+
+		for (unsigned j = 0; j < baseline.size(); j++)
+		{
+			const BaselineEntry& entry = baseline[j];
+			if (entry.scenario != name || entry.particles != result.particles || entry.threads != result.threads)
+				continue;
+
+			matched++;
+
+			double change = entry.stepsPerSecond > 0 ? (result.stepsPerSecond / entry.stepsPerSecond - 1.0) * 100.0 : 0;
+			bool regressed = change < -options.threshold;
+			if (regressed)
+				regressions++;
+
+			fprintf(stderr, "%-12s %9u %7u %14.1f %14.1f %+7.1f%%%s\n", name, result.particles, result.threads,
+				entry.stepsPerSecond, result.stepsPerSecond, change, regressed ? "  REGRESSION" : "");
+			break;
+		}
+	}
+
+	fprintf(stderr, "%u of %u runs found in the baseline, %d slower by more than %g%%\n",
+		matched, (unsigned)results.size(), regressions, options.threshold);
+
+	return regressions;
+}
+
+static void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  --scenarios LIST    comma separated: gas, pile, mix, stack, projectiles or all (default all)\n");
+	printf("  --n LIST            particle counts, e.g. 10,1k,1m (default 10,100,1k,10k,100k,1m)\n");
+	printf("  --threads LIST      thread counts, or max (default 1, 2, 4... up to max)\n");
+	printf("  --warmup N          steps run before timing starts (default 20)\n");
+	printf("  --frames N          most steps timed in each run (default 1000)\n");
+	printf("  --min-frames N      fewest steps timed in each run (default 5)\n");
+	printf("  --min-time SECONDS  time each run for at least this long, within the frame limits (default 1)\n");
+	printf("  --dt SECONDS        length of each step (default 0.01)\n");
+	printf("  --seed N            seed for laying out the scenes (default 1)\n");
+	printf("  --deterministic     run the worlds in deterministic mode\n");
+	printf("  --out FILE          write the JSON results to FILE rather than standard output\n");
+	printf("  --compare FILE      compare steps/sec with a baseline written by an earlier run\n");
+	printf("  --threshold PERCENT slowdown counted as a regression (default 10)\n");
+	printf("Exits with 2 if compare mode finds a regression.\n");
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	options.warmup = 20;
+	options.minFrames = 5;
+	options.maxFrames = 1000;
+	options.minSeconds = 1.0;
+	options.duration = 0.01f;
+	options.seed = 1;
+	options.deterministic = false;
+	options.outputFile = 0;
+	options.baselineFile = 0;
+	options.threshold = 10.0;
+
+	parseScenarios("all", options.scenarios);
+	parseList("10,100,1k,10k,100k,1m", options.counts);
+
+	unsigned maxThreads = getMaxThreads();
+	for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+		options.threads.push_back(threads);
+	options.threads.push_back(maxThreads);
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		bool valid = true;
+
+		if (strcmp(argv[i], "--scenarios") == 0 && hasValue)
+			valid = parseScenarios(argv[++i], options.scenarios);
+		else if (strcmp(argv[i], "--n") == 0 && hasValue)
+			valid = parseList(argv[++i], options.counts);
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			valid = parseList(argv[++i], options.threads);
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+			options.warmup = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+			options.maxFrames = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--min-frames") == 0 && hasValue)
+			options.minFrames = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--min-time") == 0 && hasValue)
+			options.minSeconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--dt") == 0 && hasValue)
+			options.duration = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+			options.seed = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--deterministic") == 0)
+			options.deterministic = true;
+		else if (strcmp(argv[i], "--out") == 0 && hasValue)
+			options.outputFile = argv[++i];
+		else if (strcmp(argv[i], "--compare") == 0 && hasValue)
+			options.baselineFile = argv[++i];
+		else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+			options.threshold = atof(argv[++i]);
+		else
+		{
+			printUsage(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+
+		if (!valid)
+		{
+			fprintf(stderr, "Invalid value for %s\n", argv[i - 1]);
+			return 1;
+		}
+	}
+
+	if (options.duration <= 0.0f || options.maxFrames == 0)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+	if (options.minFrames > options.maxFrames)
+		options.minFrames = options.maxFrames;
+
+	std::vector<BenchResult> results;
+
+	for (unsigned t = 0; t < options.threads.size(); t++)
+	{
+		//One thread runs everything on the calling thread, without a job system
+		JobSystem* jobs = options.threads[t] > 1 ? new JobSystem(options.threads[t]) : 0;
+
+		for (unsigned s = 0; s < options.scenarios.size(); s++)
+		{
+			for (unsigned n = 0; n < options.counts.size(); n++)
+			{
+				BenchResult result = runBenchmark(options, options.scenarios[s], options.counts[n], jobs);
+				results.push_back(result);
+
+				fprintf(stderr, "%-12s n=%-8u threads=%-3u %12.1f steps/s  step p50 %10.1f us  contacts %10.1f\n",
+					BenchScenario::getName(result.scenario), result.particles, result.threads, result.stepsPerSecond,
+					result.p50[STAGE_COUNT] / 1000.0, result.meanContacts);
+			}
+		}
+
+		delete jobs;
+	}
+
+	FILE* output = stdout;
+	if (options.outputFile)
+	{
+		output = fopen(options.outputFile, "w");
+		if (!output)
+		{
+			fprintf(stderr, "Could not open %s\n", options.outputFile);
+			return 1;
+		}
+	}
+
+	writeResults(output, options, results);
+
+	if (output != stdout)
+		fclose(output);
+
+	if (options.baselineFile)
+	{
+		int regressions = compareResults(options, results);
+		if (regressions < 0)
+			return 1;
+		if (regressions > 0)
+			return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Runs the blob demo's simulation (or one of the benchmark's generated
+ * scenes) without a window, as fast as it will go, and reports how many
+ * steps it managed each second.
+ *
+ */
+#include "BlobScene.h"
+#include "BenchScenario.h"
+#include "pjobs.h"
+#include "ptrace.h"
+#include "palloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+static void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  --frames N       number of steps to run (default 10000)\n");
+	printf("  --scenario NAME  run a generated scene (gas, pile, mix, stack or projectiles) instead of the demo's\n");
+	printf("  --n N            number of particles in the generated scene (default 10000)\n");
+	printf("  --dt SECONDS     length of each step (default 0.01, the demo's timer)\n");
+	printf("  --substeps N     run each step as N shorter ones (default 1)\n");
+	printf("  --threads N      threads to spread each step over (default 1, 0 for one per core)\n");
+	printf("  --deterministic  give the same result whatever the number of threads\n");
+	printf("  --stats          print the time taken by each stage of a step\n");
+	printf("  --hash           print a hash of the final state of the particles\n");
+	printf("  --strict-after N abort on any heap allocation once N steps have run (needs PALLOC_COUNT)\n");
+	printf("  --trace FILE     write the last steps traced to FILE as Chrome trace JSON (needs PTRACE)\n");
+	printf("  --trace-slow US  also write any step over US microseconds, to FILE-<step>.json\n");
+}
+
+int main(int argc, char** argv)
+{
+	unsigned frames = 10000;
+	const char* scenarioName = 0;
+	unsigned numParticles = 10000;
+	float duration = 0.01f;
+	int substeps = 1;
+	int threads = 1;
+	bool deterministic = false;
+	bool stats = false;
+	bool hash = false;
+	int strictAfter = -1;
+	const char* tracePath = 0;
+	double traceSlow = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--frames") == 0 && hasValue)
+			frames = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--dt") == 0 && hasValue)
+			duration = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--scenario") == 0 && hasValue)
+			scenarioName = argv[++i];
+		else if (strcmp(argv[i], "--n") == 0 && hasValue)
+			numParticles = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--substeps") == 0 && hasValue)
+			substeps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--deterministic") == 0)
+			deterministic = true;
+		else if (strcmp(argv[i], "--stats") == 0)
+			stats = true;
+		else if (strcmp(argv[i], "--hash") == 0)
+			hash = true;
+		else if (strcmp(argv[i], "--strict-after") == 0 && hasValue)
+			strictAfter = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+			tracePath = argv[++i];
+		else if (strcmp(argv[i], "--trace-slow") == 0 && hasValue)
+			traceSlow = atof(argv[++i]);
+		else
+		{
+			printUsage(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (duration <= 0.0f || substeps < 1 || threads < 0 || traceSlow < 0 || (traceSlow > 0 && !tracePath))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	BenchScenarioType type = SCENARIO_GAS;
+	if (scenarioName && !BenchScenario::findType(scenarioName, type))
+	{
+		fprintf(stderr, "Unknown scenario %s\n", scenarioName);
+		return 1;
+	}
+
+	//Only one of the scenes is made
+	BlobScene* blobScene = scenarioName ? 0 : new BlobScene;
+	BenchScenario* benchScene = scenarioName ? new BenchScenario(type, numParticles) : 0;
+	ParticleWorld& world = blobScene ? blobScene->getWorld() : benchScene->getWorld();
+
+	//One thread runs everything on this one, without a job system
+	JobSystem* jobs = 0;
+	if (threads != 1)
+	{
+		jobs = new JobSystem(threads);
+		world.setJobSystem(jobs);
+	}
+
+	world.setDeterministic(deterministic);
+
+	if (tracePath)
+	{
+		if (!Tracer::isAvailable())
+			fprintf(stderr, "Tracing was not compiled in (build with PARTICLE_TRACE)\n");
+
+		//Slow steps go in files named after the trace, without its extension
+		std::string prefix = tracePath;
+		if (prefix.size() > 5 && prefix.compare(prefix.size() - 5, 5, ".json") == 0)
+			prefix.resize(prefix.size() - 5);
+
+		Tracer::setThreadName("main");
+		Tracer::setSlowFrameDump((unsigned long long)(traceSlow * 1000.0), prefix.c_str());
+		Tracer::setEnabled(true);
+	}
+
+	if (strictAfter >= 0 && !AllocationCounter::isEnabled())
+		fprintf(stderr, "Allocations are not counted (build with PARTICLE_COUNT_ALLOCATIONS)\n");
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < frames; i++)
+	{
+		//Once warmed up, a step should not allocate at all
+		if (strictAfter >= 0 && i == (unsigned)strictAfter)
+			AllocationCounter::setStrict(true);
+
+		if (blobScene)
+			blobScene->fixedStep(duration, substeps);
+		else
+			for (int s = 0; s < substeps; s++)
+				benchScene->step(duration / substeps);
+
+		//Slow steps are written out between steps, not while they run
+		if (tracePath)
+			Tracer::writePendingDumps();
+	}
+
+	std::chrono::steady_clock::time_point finish = std::chrono::steady_clock::now();
+	AllocationCounter::setStrict(false);
+	double seconds = std::chrono::duration<double>(finish - start).count();
+
+	printf("frames: %u\n", frames);
+	printf("threads: %u\n", jobs ? jobs->getThreadCount() : 1);
+	printf("seconds: %.6f\n", seconds);
+	printf("steps/sec: %.1f\n", seconds > 0.0 ? frames / seconds : 0.0);
+
+	if (stats)
+	{
+		static const char* stageNames[STAGE_COUNT] = {
+			"forces", "integrate", "particle contacts", "platform contacts", "resolve"
+		};
+
+		//Percentiles are of the most recent steps the world keeps figures for
+		printf("%-20s %10s %10s %10s\n", "stage (us)", "p50", "p90", "p99");
+		for (int stage = 0; stage <= STAGE_COUNT; stage++)
+		{
+			ParticleWorldStage s = (ParticleWorldStage)stage;
+			printf("%-20s %10.2f %10.2f %10.2f\n", stage < STAGE_COUNT ? stageNames[stage] : "step",
+				world.getStagePercentile(s, 50) / 1000.0,
+				world.getStagePercentile(s, 90) / 1000.0,
+				world.getStagePercentile(s, 99) / 1000.0);
+		}
+
+		const ParticleWorldStats& last = world.getStats();
+		printf("contacts: %u\n", last.contacts);
+		printf("dropped contacts: %u\n", last.droppedContacts);
+		printf("iterations: %u\n", last.iterationsUsed);
+		printf("max closing velocity: %g\n", last.maxClosingVelocity);
+	}
+
+	if (hash)
+		printf("hash: %016llx\n", world.calculateStateHash());
+
+	//The world must stop using the job system before it goes
+	world.setJobSystem(0);
+	delete jobs;
+
+	delete blobScene;
+	delete benchScene;
+
+	if (tracePath && Tracer::isAvailable())
+	{
+		Tracer::setEnabled(false);
+
+		if (!Tracer::writeChromeTrace(tracePath))
+		{
+			fprintf(stderr, "Could not write %s\n", tracePath);
+			return 1;
+		}
+
+		printf("trace: %s\n", tracePath);
+		printf("slow steps traced: %u\n", Tracer::getSlowFrameDumps());
+	}
+
+	return 0;
+}
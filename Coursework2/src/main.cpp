@@ -18,6 +18,8 @@ void createWindow(const char* title, int h, int w)
 
 void TimerFunc(int value)
 {
+	//The timer only sets how often frames are drawn: the application works out how much time
+	//has really passed, so it does not matter if the frames come late
 	app->update();
 	float  timeinterval = app->getTimeinterval();
 	glutTimerFunc(timeinterval, TimerFunc, 1);
@@ -0,0 +1,697 @@
+/*
+ * Times the primitives that a step spends its time in, each on its
+ * own: the narrowphase tests, the platforms' contact generation and
+ * contact resolution. Each is timed with its data in the cache (warm)
+ * and with the caches flushed before every call (cold), giving the
+ * nanoseconds, cycles and heap allocations each call costs.
+ *
+ */
+#include "ParticleCollision.h"
+#include "pplatform.h"
+#include "pcontacts.h"
+#include "pnarrow.h"
+#include "palloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MICROBENCH_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+//Returns the time stamp counter, which counts cycles at the processor's nominal rate, or zero where there is none
+static unsigned long long readCycles()
+{
+#ifdef MICROBENCH_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//Keeps results alive, so that the compiler cannot drop the calls that make them
+static volatile float sink;
+
+//Returns a random number in [min, max), the same on every run
+static float randomFloat(float min, float max)
+{
+	static unsigned state = 12345;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return min + (max - min) * (state >> 8) * (1.0f / 16777216.0f);
+}
+
+enum Shape { SHAPE_SPHERE, SHAPE_QUAD, SHAPE_TRIANGLE };
+
+static const char* shapeNames[] = { "sphere", "quad", "triangle" };
+
+//Makes the particle into a shape of the blob demo's: spheres of radius 10, and its quad and triangle
+static void makeShape(Particle& particle, Shape shape)
+{
+	float radius = shape == SHAPE_SPHERE ? 10.0f : 20.0f;
+	particle.setRadius(radius);
+	particle.setMass(10);
+
+	std::vector<Vector2> vertices;
+	if (shape == SHAPE_QUAD)
+	{
+		vertices.push_back(Vector2(1, 1).unit() * radius);
+		vertices.push_back(Vector2(1, -1).unit() * radius);
+		vertices.push_back(Vector2(-1, -1).unit() * radius);
+		vertices.push_back(Vector2(-1, 1).unit() * radius);
+		particle.setVertices(vertices);
+		particle.setWidthAndHeight(vertices[0].x - vertices[3].x, vertices[0].y - vertices[1].y);
+	}
+	else if (shape == SHAPE_TRIANGLE)
+	{
+		vertices.push_back(Vector2(0, 1).unit() * radius);
+		vertices.push_back(Vector2(1.1f, -0.9f).unit() * radius);
+		vertices.push_back(Vector2(-1.1f, -0.9f).unit() * radius);
+		particle.setVertices(vertices);
+		particle.setWidthAndHeight(vertices[1].x - vertices[2].x, vertices[0].y - vertices[1].y);
+	}
+}
+
+/**
+ * One primitive to time. It is given a number of inputs (pairs of
+ * particles, sets of contacts...), which the timing cycles through, and
+ * if running it changes its input, it puts the input back in reset.
+ */
+class Microbenchmark
+{
+protected:
+	std::string name;
+	std::string variant;
+
+public:
+	Microbenchmark(const char* name, const std::string& variant) : name(name), variant(variant) {}
+	virtual ~Microbenchmark() {}
+
+	const std::string& getName() const { return name; }
+	const std::string& getVariant() const { return variant; }
+
+	virtual unsigned getInputCount() const = 0;
+
+	//Runs the primitive once on the given input
+	virtual void run(unsigned input) = 0;
+
+	//Returns true if run changes its input, so reset has to be called between runs
+	virtual bool changesInput() const { return false; }
+	virtual void reset(unsigned) {}
+};
+
+//Overlapping pairs of particles of two shapes, tested by ParticleCollision::checkCollision
+class CollisionBenchmark : public Microbenchmark
+{
+protected:
+	static const unsigned PAIRS = 64;
+
+	ParticleStore store;
+	std::vector<Particle> particles;
+	std::vector<float> distances;
+	ParticleCollision* collision;
+
+public:
+	CollisionBenchmark(const char* name, Shape shape1, Shape shape2)
+		: Microbenchmark(name, std::string(shapeNames[shape1]) + "_" + shapeNames[shape2]), store(PAIRS * 2)
+	{
+		particles.reserve(PAIRS * 2);
+
+		for (unsigned i = 0; i < PAIRS; i++)
+		{
+			particles.emplace_back(store);
+			particles.emplace_back(store);
+
+			Particle& a = particles[i * 2];
+			Particle& b = particles[i * 2 + 1];
+			makeShape(a, shape1);
+			makeShape(b, shape2);
+
+			//Close enough together in any direction that the shapes overlap
+			float angle = randomFloat(0, 6.2831853f);
+			float distance = 0.5f * (a.getRadius() + b.getRadius()) * randomFloat(0.5f, 0.9f);
+			a.setPosition(i * 100.0f, 0);
+			b.setPosition(i * 100.0f + cosf(angle) * distance, sinf(angle) * distance);
+
+			distances.push_back(distance);
+		}
+
+		collision = new ParticleCollision((int)particles.size(), particles.data());
+	}
+
+	~CollisionBenchmark()
+	{
+		delete collision;
+	}
+
+	unsigned getInputCount() const { return PAIRS; }
+
+	void run(unsigned input)
+	{
+		Vector2 normal;
+		float penetration = 0;
+
+		if (collision->checkCollision(particles[input * 2], particles[input * 2 + 1], distances[input], normal, penetration))
+			sink = penetration;
+	}
+};
+
+//ConvexCollision::gjk on the same pairs, which finds whether they overlap but not by how much
+class GjkBenchmark : public CollisionBenchmark
+{
+protected:
+	std::vector<ConvexShape> shapes;
+
+public:
+	GjkBenchmark(const char* name, Shape shape1, Shape shape2) : CollisionBenchmark(name, shape1, shape2), shapes(PAIRS * 2)
+	{
+		for (unsigned i = 0; i < shapes.size(); i++)
+			shapes[i].setParticle(particles[i]);
+	}
+
+	void run(unsigned input)
+	{
+		Vector2 simplex[3];
+		unsigned simplexCount;
+
+		sink = ConvexCollision::gjk(shapes[input * 2], shapes[input * 2 + 1], simplex, simplexCount) ? 1.0f : 0.0f;
+	}
+};
+
+//ConvexCollision::intersect on the same pairs: GJK, then EPA to find the penetration
+class IntersectBenchmark : public GjkBenchmark
+{
+public:
+	IntersectBenchmark(Shape shape1, Shape shape2) : GjkBenchmark("ConvexCollision::intersect", shape1, shape2) {}
+
+	void run(unsigned input)
+	{
+		Vector2 normal;
+		float penetration = 0;
+
+		if (ConvexCollision::intersect(shapes[input * 2], shapes[input * 2 + 1], normal, penetration))
+			sink = penetration;
+	}
+};
+
+//Platform::addContact over a row of spheres, every other one resting on the platform
+class PlatformBenchmark : public Microbenchmark
+{
+	ParticleStore store;
+	std::vector<Particle> particles;
+	std::vector<ParticleContact> contacts;
+	Platform platform;
+
+public:
+	PlatformBenchmark(unsigned count)
+		: Microbenchmark("Platform::addContact", "particles_" + std::to_string(count)), store(count), contacts(count)
+	{
+		particles.reserve(count);
+
+		platform.start = Vector2(-5.0f * count, 0);
+		platform.end = Vector2(5.0f * count, 0);
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			particles.emplace_back(store);
+			makeShape(particles[i], SHAPE_SPHERE);
+			particles[i].setPosition(platform.start.x + 10.0f * i + 5.0f, (i & 1) ? 30.0f : 8.0f);
+			platform.particle.push_back(&particles[i]);
+		}
+	}
+
+	unsigned getInputCount() const { return 1; }
+
+	void run(unsigned)
+	{
+		sink = (float)platform.addContact(contacts.data(), (unsigned)contacts.size());
+	}
+};
+
+//Contacts between spheres in a row, each closing on the next, resolved by ParticleContactResolver::resolveContacts.
+//The contacts, the particles and the resolver's cached impulses are put back after each call, so that every call
+//does the same work.
+class ResolverBenchmark : public Microbenchmark
+{
+	ParticleStore store;
+	std::vector<Particle> particles;
+	std::vector<ParticleContact> contacts;
+	std::vector<ParticleContact> savedContacts;
+	std::vector<Vector2> savedPositions;
+	std::vector<Vector2> savedVelocities;
+	ParticleContactResolver resolver;
+	unsigned groupSize;
+
+public:
+	//Makes groups of groupSize contacts each; each input is one group
+	ResolverBenchmark(const char* name, const std::string& variant, unsigned groupSize, unsigned groups,
+		bool sequentialImpulses, unsigned iterations)
+		: Microbenchmark(name, variant), store(groups * (groupSize + 1)), resolver(iterations), groupSize(groupSize)
+	{
+		resolver.setSequentialImpulses(sequentialImpulses);
+		particles.reserve(groups * (groupSize + 1));
+
+		for (unsigned g = 0; g < groups; g++)
+		{
+			unsigned first = (unsigned)particles.size();
+
+			for (unsigned i = 0; i <= groupSize; i++)
+			{
+				particles.emplace_back(store);
+				Particle& particle = particles.back();
+				makeShape(particle, SHAPE_SPHERE);
+				particle.setPosition(g * 1000.0f + i * 19.0f, 0);
+				particle.setVelocity(randomFloat(-20.0f, 20.0f), 0);
+			}
+
+			for (unsigned i = 0; i < groupSize; i++)
+			{
+				ParticleContact contact;
+				contact.particle[0] = &particles[first + i + 1];
+				contact.particle[1] = &particles[first + i];
+				contact.contactNormal = Vector2(1, 0);
+				contact.restitution = 0.5f;
+				contact.penetration = 1.0f;
+				contact.pairId = ParticleContact::makePairId(first + i, first + i + 1);
+				contacts.push_back(contact);
+			}
+		}
+
+		savedContacts = contacts;
+		for (unsigned i = 0; i < particles.size(); i++)
+		{
+			savedPositions.push_back(particles[i].getPosition());
+			savedVelocities.push_back(particles[i].getVelocity());
+		}
+	}
+
+	unsigned getInputCount() const { return (unsigned)contacts.size() / groupSize; }
+
+	void run(unsigned input)
+	{
+		resolver.resolveContacts(&contacts[input * groupSize], groupSize, 0.01f);
+	}
+
+	bool changesInput() const { return true; }
+
+	void reset(unsigned input)
+	{
+		unsigned firstContact = input * groupSize;
+		unsigned firstParticle = input * (groupSize + 1);
+
+		std::copy(savedContacts.begin() + firstContact, savedContacts.begin() + firstContact + groupSize,
+			contacts.begin() + firstContact);
+
+		for (unsigned i = firstParticle; i <= firstParticle + groupSize; i++)
+		{
+			particles[i].setPosition(savedPositions[i]);
+			particles[i].setVelocity(savedVelocities[i]);
+		}
+
+		//Sequential impulses start from the impulses of the last call, which would make each call cheaper than
+		//the one before. Setting the mode again forgets them.
+		resolver.setSequentialImpulses(resolver.usesSequentialImpulses());
+	}
+};
+
+//The settings of a run
+struct MicrobenchOptions
+{
+	unsigned samples;
+	unsigned coldSamples;
+	size_t evictBytes;
+	double sampleSeconds;
+	double maxSeconds;
+	const char* filter;
+	const char* outputFile;
+	bool warm;
+	bool cold;
+};
+
+//The figures for one primitive, timed warm or cold
+struct MicrobenchResult
+{
+	std::string name;
+	std::string variant;
+	bool cold;
+	unsigned samples;
+	double nsPerOp;
+	double minNsPerOp;
+	double cyclesPerOp;
+	double allocationsPerOp;
+};
+
+//Memory written over between calls, to push everything else out of the caches
+static std::vector<char> evictBuffer;
+
+static void evictCaches()
+{
+	//Writing each cache line is enough to evict what was there
+	for (size_t i = 0; i < evictBuffer.size(); i += 64)
+		evictBuffer[i]++;
+}
+
+//Returns the size of the last level cache, or a guess larger than most where it cannot be found. Some virtual
+//machines report a cache far larger than any real one, so the size is capped.
+static size_t getCacheSize()
+{
+	const size_t largest = 128 * 1024 * 1024;
+
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+	long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (size > 0)
+		return (size_t)size < largest ? (size_t)size : largest;
+#endif
+	return 32 * 1024 * 1024;
+}
+
+//One timed stretch: nanoseconds, cycles and allocations, and the number of calls it covered
+struct Sample
+{
+	double ns;
+	double cycles;
+	unsigned long long allocations;
+	unsigned ops;
+};
+
+//Times ops calls to run, starting at the given input and cycling through the inputs
+static Sample timeRuns(Microbenchmark& benchmark, unsigned& input, unsigned ops)
+{
+	unsigned inputs = benchmark.getInputCount();
+
+	//The cycle count is read inside the clock's reads, so that it does not include the clock missing the cache
+	AllocationCounts allocationsBefore = AllocationCounter::getCounts();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned long long cyclesBefore = readCycles();
+
+	for (unsigned i = 0; i < ops; i++)
+	{
+		benchmark.run(input);
+		if (++input == inputs)
+			input = 0;
+	}
+
+	unsigned long long cyclesAfter = readCycles();
+	std::chrono::steady_clock::time_point finish = std::chrono::steady_clock::now();
+	AllocationCounts allocationsAfter = AllocationCounter::getCounts();
+
+	Sample sample;
+	sample.ns = std::chrono::duration<double, std::nano>(finish - start).count();
+	sample.cycles = (double)(cyclesAfter - cyclesBefore);
+	sample.allocations = allocationsAfter.allocations - allocationsBefore.allocations;
+	sample.ops = ops;
+	return sample;
+}
+
+//Times an empty stretch, to find what the timing itself costs
+static Sample timeNothing()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned long long cyclesBefore = readCycles();
+	unsigned long long cyclesAfter = readCycles();
+	std::chrono::steady_clock::time_point finish = std::chrono::steady_clock::now();
+
+	Sample sample;
+	sample.ns = std::chrono::duration<double, std::nano>(finish - start).count();
+	sample.cycles = (double)(cyclesAfter - cyclesBefore);
+	sample.allocations = 0;
+	sample.ops = 1;
+	return sample;
+}
+
+//The fewest samples taken of a primitive, however long they take
+static const unsigned MIN_SAMPLES = 10;
+
+static double median(std::vector<double>& values)
+{
+	std::sort(values.begin(), values.end());
+	return values.empty() ? 0 : values[values.size() / 2];
+}
+
+/**
+ * Times a primitive. Warm, if it leaves its input alone, it is run in
+ * batches long enough that the clock's resolution does not matter;
+ * otherwise, and always when cold, each call is timed alone (after the
+ * input is reset and, if cold, the caches flushed), less the median
+ * cost of timing nothing.
+ */
+static MicrobenchResult measure(Microbenchmark& benchmark, bool cold, const MicrobenchOptions& options,
+	const Sample& overhead)
+{
+	unsigned inputs = benchmark.getInputCount();
+	bool single = cold || benchmark.changesInput();
+	unsigned samples = cold ? options.coldSamples : options.samples;
+
+	MicrobenchResult result;
+	result.name = benchmark.getName();
+	result.variant = benchmark.getVariant();
+	result.cold = cold;
+	result.samples = samples;
+
+	//Warm up every input, and everything the primitive allocates once and then reuses
+	unsigned input = 0;
+	for (unsigned i = 0; i < inputs * 2; i++)
+	{
+		if (benchmark.changesInput())
+			benchmark.reset(input);
+		timeRuns(benchmark, input, 1);
+	}
+
+	//Batches grow until they take as long as a sample should
+	unsigned batch = 1;
+	if (!single)
+		while (batch < (1u << 24) && timeRuns(benchmark, input, batch).ns < options.sampleSeconds * 1e9)
+			batch *= 2;
+
+	std::vector<double> ns, cycles;
+	unsigned long long allocations = 0, ops = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (unsigned s = 0; s < samples; s++)
+	{
+		//Slow primitives stop early, once they have enough samples to go on
+		if (s >= MIN_SAMPLES && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > options.maxSeconds)
+		{
+			result.samples = s;
+			break;
+		}
+
+		if (single)
+		{
+			if (benchmark.changesInput())
+				benchmark.reset(input);
+			if (cold)
+				evictCaches();
+		}
+
+		Sample sample = timeRuns(benchmark, input, batch);
+		if (single)
+		{
+			sample.ns = sample.ns > overhead.ns ? sample.ns - overhead.ns : 0;
+			sample.cycles = sample.cycles > overhead.cycles ? sample.cycles - overhead.cycles : 0;
+		}
+
+		ns.push_back(sample.ns / sample.ops);
+		cycles.push_back(sample.cycles / sample.ops);
+		allocations += sample.allocations;
+		ops += sample.ops;
+	}
+
+	result.minNsPerOp = *std::min_element(ns.begin(), ns.end());
+	result.nsPerOp = median(ns);
+	result.cyclesPerOp = median(cycles);
+	result.allocationsPerOp = ops ? (double)allocations / ops : 0;
+	return result;
+}
+
+static void writeResults(FILE* file, const MicrobenchOptions& options, const std::vector<MicrobenchResult>& results)
+{
+	fprintf(file, "{\n  \"version\": 1,\n");
+	fprintf(file, "  \"settings\": {\"samples\": %u, \"cold_samples\": %u, \"evict_bytes\": %llu, "
+		"\"tsc_cycles\": %s, \"counting_allocations\": %s},\n",
+		options.samples, options.coldSamples, (unsigned long long)options.evictBytes,
+		readCycles() ? "true" : "false", AllocationCounter::isEnabled() ? "true" : "false");
+	fprintf(file, "  \"results\": [\n");
+
+	for (unsigned i = 0; i < results.size(); i++)
+	{
+		const MicrobenchResult& result = results[i];
+		fprintf(file, "    {\"kernel\": \"%s\", \"variant\": \"%s\", \"cache\": \"%s\", \"samples\": %u, "
+			"\"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, \"cycles_per_op\": %.1f, \"allocations_per_op\": %.3f}%s\n",
+			result.name.c_str(), result.variant.c_str(), result.cold ? "cold" : "warm", result.samples,
+			result.nsPerOp, result.minNsPerOp, result.cyclesPerOp, result.allocationsPerOp,
+			i + 1 == results.size() ? "" : ",");
+	}
+
+	fprintf(file, "  ]\n}\n");
+}
+
+static void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  --filter TEXT       only run primitives whose name or variant contains TEXT\n");
+	printf("  --samples N         warm samples for each primitive (default 200)\n");
+	printf("  --cold-samples N    cold samples for each primitive (default 100)\n");
+	printf("  --sample-time SECS  length of each warm batch (default 0.0001)\n");
+	printf("  --max-time SECS     stop sampling a primitive after this long, once it has %u samples (default 1)\n", MIN_SAMPLES);
+	printf("  --evict-bytes N     memory written to flush the caches (default twice the last level cache)\n");
+	printf("  --warm-only         skip the cold timings\n");
+	printf("  --cold-only         skip the warm timings\n");
+	printf("  --out FILE          also write the results as JSON to FILE\n");
+	printf("Cycles are time stamp counter cycles, which tick at the processor's nominal rate.\n");
+	printf("Allocations are only counted when built with PALLOC_COUNT.\n");
+}
+
+int main(int argc, char** argv)
+{
+	MicrobenchOptions options;
+	options.samples = 200;
+	options.coldSamples = 100;
+	options.evictBytes = getCacheSize() * 2;
+	options.sampleSeconds = 0.0001;
+	options.maxSeconds = 1.0;
+	options.filter = 0;
+	options.outputFile = 0;
+	options.warm = true;
+	options.cold = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--filter") == 0 && hasValue)
+			options.filter = argv[++i];
+		else if (strcmp(argv[i], "--samples") == 0 && hasValue)
+			options.samples = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--cold-samples") == 0 && hasValue)
+			options.coldSamples = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--sample-time") == 0 && hasValue)
+			options.sampleSeconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--max-time") == 0 && hasValue)
+			options.maxSeconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--evict-bytes") == 0 && hasValue)
+			options.evictBytes = (size_t)strtoull(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--warm-only") == 0)
+			options.cold = false;
+		else if (strcmp(argv[i], "--cold-only") == 0)
+			options.warm = false;
+		else if (strcmp(argv[i], "--out") == 0 && hasValue)
+			options.outputFile = argv[++i];
+		else
+		{
+			printUsage(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (options.samples == 0 || options.coldSamples == 0)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	evictBuffer.assign(options.evictBytes, 0);
+
+	std::vector<Microbenchmark*> benchmarks;
+
+	static const Shape pairs[][2] = {
+		{ SHAPE_SPHERE, SHAPE_SPHERE }, { SHAPE_SPHERE, SHAPE_QUAD }, { SHAPE_SPHERE, SHAPE_TRIANGLE },
+		{ SHAPE_QUAD, SHAPE_QUAD }, { SHAPE_QUAD, SHAPE_TRIANGLE }, { SHAPE_TRIANGLE, SHAPE_TRIANGLE }
+	};
+	for (unsigned i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+		benchmarks.push_back(new CollisionBenchmark("ParticleCollision::checkCollision", pairs[i][0], pairs[i][1]));
+
+	benchmarks.push_back(new GjkBenchmark("ConvexCollision::gjk", SHAPE_QUAD, SHAPE_QUAD));
+	benchmarks.push_back(new GjkBenchmark("ConvexCollision::gjk", SHAPE_QUAD, SHAPE_TRIANGLE));
+	benchmarks.push_back(new IntersectBenchmark(SHAPE_QUAD, SHAPE_QUAD));
+	benchmarks.push_back(new IntersectBenchmark(SHAPE_QUAD, SHAPE_TRIANGLE));
+
+	benchmarks.push_back(new PlatformBenchmark(12));
+	benchmarks.push_back(new PlatformBenchmark(1000));
+
+	//The resolver on a single contact. resolveVelocity is private to the contact, so this is the nearest to its
+	//cost that can be timed, but it includes the resolver's search for the contact and its other bookkeeping.
+	benchmarks.push_back(new ResolverBenchmark("ParticleContactResolver::resolveContacts", "heap_1", 1, 64, false, 1));
+
+	static const unsigned counts[] = { 10, 100, 1000, 10000 };
+	for (unsigned i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+	{
+		//Enough groups that the warm timings cycle through a few, without using much memory for the largest
+		unsigned groups = counts[i] >= 1000 ? 2 : 16;
+		std::string contacts = std::to_string(counts[i]);
+
+		benchmarks.push_back(new ResolverBenchmark("ParticleContactResolver::resolveContacts", "heap_" + contacts,
+			counts[i], groups, false, counts[i] * 2));
+		benchmarks.push_back(new ResolverBenchmark("ParticleContactResolver::resolveContacts", "impulses_" + contacts,
+			counts[i], groups, true, counts[i] * 2));
+	}
+
+	//The cost of the timing itself, taken off the calls timed one at a time
+	std::vector<double> overheadNs, overheadCycles;
+	for (unsigned i = 0; i < 1000; i++)
+	{
+		Sample sample = timeNothing();
+		overheadNs.push_back(sample.ns);
+		overheadCycles.push_back(sample.cycles);
+	}
+	Sample overhead;
+	overhead.ns = median(overheadNs);
+	overhead.cycles = median(overheadCycles);
+
+	printf("%-42s %-22s %-5s %12s %12s %12s %10s\n", "kernel", "variant", "cache", "ns/op", "min ns/op", "cycles/op", "allocs/op");
+
+	std::vector<MicrobenchResult> results;
+	for (unsigned b = 0; b < benchmarks.size(); b++)
+	{
+		Microbenchmark& benchmark = *benchmarks[b];
+
+		if (options.filter && benchmark.getName().find(options.filter) == std::string::npos &&
+			benchmark.getVariant().find(options.filter) == std::string::npos)
+			continue;
+
+		for (int cold = 0; cold < 2; cold++)
+		{
+			if ((cold && !options.cold) || (!cold && !options.warm))
+				continue;
+
+			MicrobenchResult result = measure(benchmark, cold != 0, options, overhead);
+			results.push_back(result);
+
+			printf("%-42s %-22s %-5s %12.1f %12.1f %12.1f %10.3f\n", result.name.c_str(), result.variant.c_str(),
+				cold ? "cold" : "warm", result.nsPerOp, result.minNsPerOp, result.cyclesPerOp, result.allocationsPerOp);
+			fflush(stdout);
+		}
+	}
+
+	if (options.outputFile)
+	{
+		FILE* output = fopen(options.outputFile, "w");
+		if (!output)
+		{
+			fprintf(stderr, "Could not open %s\n", options.outputFile);
+			return 1;
+		}
+
+		writeResults(output, options, results);
+		fclose(output);
+	}
+
+	for (unsigned b = 0; b < benchmarks.size(); b++)
+		delete benchmarks[b];
+
+	return 0;
+}
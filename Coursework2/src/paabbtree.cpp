@@ -0,0 +1,637 @@
+#include <math.h>
+#include <float.h>
+#include <paabbtree.h>
+#include <pjobs.h>
+
+//The number of particles each thread looks up at a time
+static const unsigned QUERY_GRAIN = 256;
+
+//Half the perimeter of a box, used as the cost of a node when choosing where to insert a leaf
+static float boxCost(const Vector2& min, const Vector2& max)
+{
+	return (max.x - min.x) + (max.y - min.y);
+}
+
+static bool boxesOverlap(const Vector2& minA, const Vector2& maxA, const Vector2& minB, const Vector2& maxB)
+{
+	return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y;
+}
+
+static void combineBoxes(const Vector2& minA, const Vector2& maxA, const Vector2& minB, const Vector2& maxB,
+	Vector2& min, Vector2& max)
+{
+	min = Vector2(minA.x < minB.x ? minA.x : minB.x, minA.y < minB.y ? minA.y : minB.y);
+	max = Vector2(maxA.x > maxB.x ? maxA.x : maxB.x, maxA.y > maxB.y ? maxA.y : maxB.y);
+}
+
+//Returns true if the ray enters the box before maxDistance
+static bool rayHitsBox(const Vector2& origin, const Vector2& direction, float maxDistance,
+	const Vector2& min, const Vector2& max)
+{
+	float tEnter = 0;
+	float tExit = maxDistance;
+
+	for (unsigned axis = 0; axis < 2; axis++)
+	{
+		if (direction[axis] == 0)
+		{
+			if (origin[axis] < min[axis] || origin[axis] > max[axis])
+				return false;
+			continue;
+		}
+
+		float inverse = 1.0f / direction[axis];
+		float t1 = (min[axis] - origin[axis]) * inverse;
+		float t2 = (max[axis] - origin[axis]) * inverse;
+
+		if (t1 > t2)
+		{
+			float temp = t1;
+			t1 = t2;
+			t2 = temp;
+		}
+
+		if (t1 > tEnter) tEnter = t1;
+		if (t2 < tExit) tExit = t2;
+
+		if (tEnter > tExit)
+			return false;
+	}
+
+	return true;
+}
+
+//Exact ray test against a particle's shape. Returns the distance to the hit, or a negative value for a miss.
+static float rayHitsParticle(const Vector2& origin, const Vector2& direction, float maxDistance, Particle& particle)
+{
+	Vector2 position = particle.getPosition();
+
+	if (particle.isSphere())
+	{
+		float radius = particle.getRadius();
+		Vector2 toOrigin = origin - position;
+
+		float c = toOrigin.squareMagnitude() - radius * radius;
+		if (c <= 0)
+			return 0;
+
+		float a = direction.squareMagnitude();
+		float b = toOrigin * direction;
+		float discriminant = b * b - a * c;
+
+		if (b >= 0 || discriminant < 0)
+			return -1;
+
+		float t = (-b - sqrt(discriminant)) / a;
+		return t <= maxDistance ? t : -1;
+	}
+
+	//Clip the ray against each edge of the convex polygon in turn
+	std::vector<Vector2>& vertices = particle.getVertices();
+	unsigned count = vertices.size();
+
+	//Find the winding of the polygon so that edge normals can be made to point outwards
+	float area = 0;
+	for (unsigned i = 0, j = count - 1; i < count; j = i++)
+		area += vertices[j].x * vertices[i].y - vertices[i].x * vertices[j].y;
+	float winding = area >= 0 ? 1.0f : -1.0f;
+
+	float tEnter = 0;
+	float tExit = maxDistance;
+
+	for (unsigned i = 0, j = count - 1; i < count; j = i++)
+	{
+		Vector2 edge = vertices[i] - vertices[j];
+		Vector2 normal = Vector2(edge.y, -edge.x) * winding;
+
+		float numerator = normal * (vertices[j] + position - origin);
+		float denominator = normal * direction;
+
+		if (denominator == 0)
+		{
+			//Parallel to this edge, and outside it
+			if (numerator < 0)
+				return -1;
+			continue;
+		}
+
+		float t = numerator / denominator;
+
+		if (denominator < 0)
+		{
+			if (t > tEnter) tEnter = t;
+		}
+		else
+		{
+			if (t < tExit) tExit = t;
+		}
+
+		if (tEnter > tExit)
+			return -1;
+	}
+
+	return tEnter;
+}
+
+ParticleAABBTree::ParticleAABBTree(float margin)
+	:
+	root(NULL_NODE),
+	freeList(NULL_NODE),
+	margin(margin),
+	trackedParticles(0),
+	trackedCount(0),
+	jobs(0)
+{
+}
+
+void ParticleAABBTree::setMargin(float margin)
+{
+	ParticleAABBTree::margin = margin;
+}
+
+int ParticleAABBTree::getHeight() const
+{
+	return root == NULL_NODE ? -1 : nodes[root].height;
+}
+
+int ParticleAABBTree::allocateNode()
+{
+	if (freeList == NULL_NODE)
+	{
+		Node node;
+		node.height = -1;
+		node.parent = NULL_NODE;
+		nodes.push_back(node);
+		freeList = nodes.size() - 1;
+	}
+
+	int node = freeList;
+	freeList = nodes[node].parent;
+
+	nodes[node].parent = NULL_NODE;
+	nodes[node].child1 = NULL_NODE;
+	nodes[node].child2 = NULL_NODE;
+	nodes[node].height = 0;
+	return node;
+}
+
+void ParticleAABBTree::freeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+void ParticleAABBTree::insertLeaf(int leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	//Walk down the tree, choosing the child that would grow least by taking the leaf
+	Vector2 leafMin = nodes[leaf].min;
+	Vector2 leafMax = nodes[leaf].max;
+	int index = root;
+
+	while (!nodes[index].isLeaf())
+	{
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+
+		Vector2 combinedMin, combinedMax;
+		combineBoxes(nodes[index].min, nodes[index].max, leafMin, leafMax, combinedMin, combinedMax);
+
+		float area = boxCost(nodes[index].min, nodes[index].max);
+		float combinedArea = boxCost(combinedMin, combinedMax);
+
+		//Cost of making a new parent for this node and the leaf
+		float cost = 2.0f * combinedArea;
+
+		//Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCost[2];
+		int children[2] = { child1, child2 };
+
+		for (unsigned c = 0; c < 2; c++)
+		{
+			const Node& child = nodes[children[c]];
+			combineBoxes(child.min, child.max, leafMin, leafMax, combinedMin, combinedMax);
+
+			childCost[c] = boxCost(combinedMin, combinedMax) + inheritanceCost;
+			if (!child.isLeaf())
+				childCost[c] -= boxCost(child.min, child.max);
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+
+		index = childCost[0] < childCost[1] ? child1 : child2;
+	}
+
+	//Make a new parent for the leaf and the sibling we stopped at
+	int sibling = index;
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+
+	nodes[newParent].parent = oldParent;
+	combineBoxes(leafMin, leafMax, nodes[sibling].min, nodes[sibling].max, nodes[newParent].min, nodes[newParent].max);
+	nodes[newParent].height = nodes[sibling].height + 1;
+
+	if (oldParent != NULL_NODE)
+	{
+		if (nodes[oldParent].child1 == sibling)
+			nodes[oldParent].child1 = newParent;
+		else
+			nodes[oldParent].child2 = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	refitAncestors(nodes[leaf].parent);
+}
+
+void ParticleAABBTree::removeLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	//The sibling takes its parent's place
+	if (grandParent != NULL_NODE)
+	{
+		if (nodes[grandParent].child1 == parent)
+			nodes[grandParent].child1 = sibling;
+		else
+			nodes[grandParent].child2 = sibling;
+
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		refitAncestors(grandParent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		freeNode(parent);
+	}
+}
+
+void ParticleAABBTree::refitAncestors(int node)
+{
+	while (node != NULL_NODE)
+	{
+		node = balance(node);
+
+		int child1 = nodes[node].child1;
+		int child2 = nodes[node].child2;
+
+		int height1 = nodes[child1].height;
+		int height2 = nodes[child2].height;
+		nodes[node].height = 1 + (height1 > height2 ? height1 : height2);
+		combineBoxes(nodes[child1].min, nodes[child1].max, nodes[child2].min, nodes[child2].max, nodes[node].min, nodes[node].max);
+
+		node = nodes[node].parent;
+	}
+}
+
+int ParticleAABBTree::balance(int iA)
+{
+	Node* A = &nodes[iA];
+	if (A->isLeaf() || A->height < 2)
+		return iA;
+
+	int iB = A->child1;
+	int iC = A->child2;
+	Node* B = &nodes[iB];
+	Node* C = &nodes[iC];
+
+	int difference = C->height - B->height;
+
+	//Rotate C up
+	if (difference > 1)
+	{
+		int iF = C->child1;
+		int iG = C->child2;
+		Node* F = &nodes[iF];
+		Node* G = &nodes[iG];
+
+		//Swap A and C
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		//A's old parent should point to C
+		if (C->parent != NULL_NODE)
+		{
+			if (nodes[C->parent].child1 == iA)
+				nodes[C->parent].child1 = iC;
+			else
+				nodes[C->parent].child2 = iC;
+		}
+		else
+		{
+			root = iC;
+		}
+
+		//Keep the taller of F and G under C
+		if (F->height > G->height)
+		{
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+			combineBoxes(B->min, B->max, G->min, G->max, A->min, A->max);
+			combineBoxes(A->min, A->max, F->min, F->max, C->min, C->max);
+
+			A->height = 1 + (B->height > G->height ? B->height : G->height);
+			C->height = 1 + (A->height > F->height ? A->height : F->height);
+		}
+		else
+		{
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+			combineBoxes(B->min, B->max, F->min, F->max, A->min, A->max);
+			combineBoxes(A->min, A->max, G->min, G->max, C->min, C->max);
+
+			A->height = 1 + (B->height > F->height ? B->height : F->height);
+			C->height = 1 + (A->height > G->height ? A->height : G->height);
+		}
+
+		return iC;
+	}
+
+	//Rotate B up
+	if (difference < -1)
+	{
+		int iD = B->child1;
+		int iE = B->child2;
+		Node* D = &nodes[iD];
+		Node* E = &nodes[iE];
+
+		//Swap A and B
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		//A's old parent should point to B
+		if (B->parent != NULL_NODE)
+		{
+			if (nodes[B->parent].child1 == iA)
+				nodes[B->parent].child1 = iB;
+			else
+				nodes[B->parent].child2 = iB;
+		}
+		else
+		{
+			root = iB;
+		}
+
+		//Keep the taller of D and E under B
+		if (D->height > E->height)
+		{
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+			combineBoxes(C->min, C->max, E->min, E->max, A->min, A->max);
+			combineBoxes(A->min, A->max, D->min, D->max, B->min, B->max);
+
+			A->height = 1 + (C->height > E->height ? C->height : E->height);
+			B->height = 1 + (A->height > D->height ? A->height : D->height);
+		}
+		else
+		{
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+			combineBoxes(C->min, C->max, D->min, D->max, A->min, A->max);
+			combineBoxes(A->min, A->max, E->min, E->max, B->min, B->max);
+
+			A->height = 1 + (C->height > D->height ? C->height : D->height);
+			B->height = 1 + (A->height > E->height ? A->height : E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+void ParticleAABBTree::setLeafBounds(int leaf, unsigned particle)
+{
+	nodes[leaf].min = Vector2(mins[particle].x - margin, mins[particle].y - margin);
+	nodes[leaf].max = Vector2(maxs[particle].x + margin, maxs[particle].y + margin);
+}
+
+void ParticleAABBTree::rebuild(Particle* particles, unsigned count)
+{
+	nodes.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+
+	trackedParticles = particles;
+	trackedCount = count;
+
+	leaves.resize(count);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		int leaf = allocateNode();
+		nodes[leaf].particle = i;
+		setLeafBounds(leaf, i);
+		insertLeaf(leaf);
+		leaves[i] = leaf;
+	}
+}
+
+void ParticleAABBTree::update(Particle* particles, unsigned count)
+{
+	pairs.clear();
+
+	mins.resize(count);
+	maxs.resize(count);
+
+	for (unsigned i = 0; i < count; i++)
+		calcBounds(particles[i], mins[i], maxs[i]);
+
+	if (particles != trackedParticles || count != trackedCount)
+	{
+		rebuild(particles, count);
+	}
+	else
+	{
+		//Only particles that have left their fattened bounds need to move in the tree
+		for (unsigned i = 0; i < count; i++)
+		{
+			int leaf = leaves[i];
+
+			if (mins[i] >= nodes[leaf].min && maxs[i] <= nodes[leaf].max)
+				continue;
+
+			removeLeaf(leaf);
+			setLeafBounds(leaf, i);
+			insertLeaf(leaf);
+		}
+	}
+
+	//Only particles that can move need looking up
+	active.resize(count);
+	for (unsigned i = 0; i < count; i++)
+		active[i] = particles[i].isAwake() && particles[i].getInverseMass() > 0;
+
+	//Look up each moving particle's exact bounds in the tree, on as many threads as there are
+	if (!jobs || jobs->getThreadCount() == 1)
+	{
+		queryParticles(0, count, pairs, stack);
+		return;
+	}
+
+	threadPairs.resize(jobs->getThreadCount());
+	threadStacks.resize(jobs->getThreadCount());
+
+	for (unsigned t = 0; t < threadPairs.size(); t++)
+		threadPairs[t].clear();
+
+	jobs->parallelFor(count, QUERY_GRAIN, queryRange, this);
+
+	//Each thread kept its own pairs, so they only need joining up
+	for (unsigned t = 0; t < threadPairs.size(); t++)
+		pairs.insert(pairs.end(), threadPairs[t].begin(), threadPairs[t].end());
+}
+
+void ParticleAABBTree::queryRange(void* context, unsigned begin, unsigned end, unsigned thread)
+{
+	ParticleAABBTree* tree = (ParticleAABBTree*)context;
+	tree->queryParticles(begin, end, tree->threadPairs[thread], tree->threadStacks[thread]);
+}
+
+void ParticleAABBTree::queryParticles(unsigned begin, unsigned end, std::vector<ParticlePair>& found,
+	std::vector<int>& walk) const
+{
+	//A pair of moving particles is found twice, so only keep it when looking up the lower numbered particle
+	for (unsigned i = begin; i < end; i++)
+	{
+		if (!active[i])
+			continue;
+
+		walk.clear();
+		walk.push_back(root);
+
+		while (!walk.empty())
+		{
+			int node = walk.back();
+			walk.pop_back();
+
+			if (node == NULL_NODE || !boxesOverlap(mins[i], maxs[i], nodes[node].min, nodes[node].max))
+				continue;
+
+			if (!nodes[node].isLeaf())
+			{
+				walk.push_back(nodes[node].child1);
+				walk.push_back(nodes[node].child2);
+				continue;
+			}
+
+			unsigned j = nodes[node].particle;
+
+			if (j != i && (j > i || !active[j]) && boxesOverlap(mins[i], maxs[i], mins[j], maxs[j]))
+			{
+				ParticlePair pair;
+				pair.first = i < j ? i : j;
+				pair.second = i < j ? j : i;
+				found.push_back(pair);
+			}
+		}
+	}
+}
+
+void ParticleAABBTree::setJobSystem(JobSystem* jobs)
+{
+	ParticleAABBTree::jobs = jobs;
+}
+
+void ParticleAABBTree::queryRegion(const Vector2& min, const Vector2& max, std::vector<unsigned>& results) const
+{
+	results.clear();
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		if (node == NULL_NODE || !boxesOverlap(min, max, nodes[node].min, nodes[node].max))
+			continue;
+
+		if (!nodes[node].isLeaf())
+		{
+			stack.push_back(nodes[node].child1);
+			stack.push_back(nodes[node].child2);
+			continue;
+		}
+
+		unsigned particle = nodes[node].particle;
+
+		if (boxesOverlap(min, max, mins[particle], maxs[particle]))
+			results.push_back(particle);
+	}
+}
+
+int ParticleAABBTree::rayCast(const Vector2& origin, const Vector2& direction, float maxDistance, float* hitDistance) const
+{
+	int closest = -1;
+	float closestDistance = maxDistance;
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		//Anything beyond the closest hit so far can be skipped
+		if (node == NULL_NODE || !rayHitsBox(origin, direction, closestDistance, nodes[node].min, nodes[node].max))
+			continue;
+
+		if (!nodes[node].isLeaf())
+		{
+			stack.push_back(nodes[node].child1);
+			stack.push_back(nodes[node].child2);
+			continue;
+		}
+
+		unsigned particle = nodes[node].particle;
+		float distance = rayHitsParticle(origin, direction, closestDistance, trackedParticles[particle]);
+
+		if (distance >= 0 && (closest < 0 || distance < closestDistance))
+		{
+			closest = particle;
+			closestDistance = distance;
+		}
+	}
+
+	if (closest >= 0 && hitDistance)
+		*hitDistance = closestDistance;
+
+	return closest;
+}
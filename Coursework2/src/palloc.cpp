@@ -0,0 +1,131 @@
+#include <palloc.h>
+
+#ifdef PALLOC_COUNT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<unsigned long long> allocationCount(0);
+static std::atomic<unsigned long long> allocationBytes(0);
+static std::atomic<bool> strictMode(false);
+
+//Counts an allocation, and stops the program if allocations are not allowed
+static void countAllocation(size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+	if (strictMode.load(std::memory_order_relaxed))
+	{
+		fprintf(stderr, "Heap allocation of %u bytes in strict mode\n", (unsigned)size);
+		abort();
+	}
+}
+
+static void* allocate(size_t size)
+{
+	countAllocation(size);
+
+	void* memory = malloc(size ? size : 1);
+	if (!memory)
+		throw std::bad_alloc();
+
+	return memory;
+}
+
+static void* allocate(size_t size, const std::nothrow_t&)
+{
+	countAllocation(size);
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t& nothrow) noexcept { return allocate(size, nothrow); }
+void* operator new[](size_t size, const std::nothrow_t& nothrow) noexcept { return allocate(size, nothrow); }
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { free(memory); }
+
+#ifdef __cpp_aligned_new
+//Over-aligned types keep the pointer malloc returned just before the memory, so it can be freed
+static void* allocateAligned(size_t size, std::align_val_t alignment)
+{
+	countAllocation(size);
+
+	size_t align = (size_t)alignment;
+	char* block = (char*)malloc(size + align + sizeof(void*));
+	if (!block)
+		throw std::bad_alloc();
+
+	char* aligned = (char*)(((size_t)(block + sizeof(void*)) + align - 1) & ~(align - 1));
+	((void**)aligned)[-1] = block;
+
+	return aligned;
+}
+
+static void freeAligned(void* memory)
+{
+	if (memory)
+		free(((void**)memory)[-1]);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void operator delete(void* memory, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { freeAligned(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { freeAligned(memory); }
+#endif
+
+bool AllocationCounter::isEnabled()
+{
+	return true;
+}
+
+AllocationCounts AllocationCounter::getCounts()
+{
+	AllocationCounts counts;
+	counts.allocations = allocationCount.load(std::memory_order_relaxed);
+	counts.bytes = allocationBytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+void AllocationCounter::setStrict(bool strict)
+{
+	strictMode.store(strict, std::memory_order_relaxed);
+}
+
+bool AllocationCounter::isStrict()
+{
+	return strictMode.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::isEnabled()
+{
+	return false;
+}
+
+AllocationCounts AllocationCounter::getCounts()
+{
+	return AllocationCounts();
+}
+
+void AllocationCounter::setStrict(bool)
+{
+}
+
+bool AllocationCounter::isStrict()
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <parena.h>
+
+//The smallest block the arena adds
+static const size_t MIN_BLOCK = 4096;
+
+FrameArena::FrameArena(size_t initialSize)
+	:
+	used(0),
+	usedBefore(0),
+	highWater(0)
+{
+	if (initialSize > 0)
+		addBlock(initialSize);
+}
+
+FrameArena::~FrameArena()
+{
+	for (unsigned i = 0; i < blocks.size(); i++)
+		delete[] blocks[i].memory;
+}
+
+void FrameArena::addBlock(size_t size)
+{
+	if (!blocks.empty())
+		usedBefore += used;
+
+	//Each block is at least twice the size of the last, so a frame needs few of them
+	if (!blocks.empty() && size < blocks.back().size * 2)
+		size = blocks.back().size * 2;
+	if (size < MIN_BLOCK)
+		size = MIN_BLOCK;
+
+	Block block = { new char[size], size };
+	blocks.push_back(block);
+	used = 0;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+	if (!blocks.empty())
+	{
+		Block& block = blocks.back();
+		size_t start = ((size_t)(block.memory + used) + alignment - 1) & ~(alignment - 1);
+		size_t offset = start - (size_t)block.memory;
+
+		if (offset + size <= block.size)
+		{
+			used = offset + size;
+			return block.memory + offset;
+		}
+	}
+
+	//There is not enough room left, so start a block with room for this and the alignment
+	addBlock(size + alignment);
+	return allocate(size, alignment);
+}
+
+void FrameArena::reset()
+{
+	size_t total = getUsed();
+	if (total > highWater)
+		highWater = total;
+
+	//Swap several blocks for one, so the next frame like this one fits in a single block
+	if (blocks.size() > 1)
+	{
+		size_t size = getCapacity();
+
+		for (unsigned i = 0; i < blocks.size(); i++)
+			delete[] blocks[i].memory;
+		blocks.clear();
+
+		usedBefore = 0;
+		addBlock(size);
+	}
+
+	used = 0;
+	usedBefore = 0;
+}
+
+size_t FrameArena::getUsed() const
+{
+	return usedBefore + used;
+}
+
+size_t FrameArena::getCapacity() const
+{
+	size_t capacity = 0;
+
+	for (unsigned i = 0; i < blocks.size(); i++)
+		capacity += blocks[i].size;
+
+	return capacity;
+}
+
+size_t FrameArena::getHighWater() const
+{
+	size_t total = getUsed();
+	return total > highWater ? total : highWater;
+}
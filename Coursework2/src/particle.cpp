@@ -3,21 +3,125 @@
 #include <assert.h>
 #include <float.h>
 
+const Vector2 Vector2::GRAVITY = Vector2(0, -9.81);
+
+Particle::Particle()
+	:
+	store(&ParticleStore::getDefault()),
+	width(0),
+	height(0),
+	boundingRadius(0),
+	localMin(0, 0),
+	localMax(0, 0)
+{
+	index = store->allocate();
+}
+
+Particle::Particle(ParticleStore& store)
+	:
+	store(&store),
+	width(0),
+	height(0),
+	boundingRadius(0),
+	localMin(0, 0),
+	localMax(0, 0)
+{
+	index = store.allocate();
+}
+
+Particle::Particle(const Particle& other)
+	:
+	store(other.store),
+	sphere(other.sphere),
+	vertices(other.vertices),
+	width(other.width),
+	height(other.height),
+	boundingRadius(other.boundingRadius),
+	localMin(other.localMin),
+	localMax(other.localMax)
+{
+	index = store->allocate();
+	*this = other;
+}
+
+Particle::Particle(Particle&& other)
+	:
+	store(other.store),
+	index(other.index),
+	sphere(other.sphere),
+	vertices(std::move(other.vertices)),
+	width(other.width),
+	height(other.height),
+	boundingRadius(other.boundingRadius),
+	localMin(other.localMin),
+	localMax(other.localMax)
+{
+	//The slot now belongs to this particle
+	other.store = 0;
+}
+
+Particle& Particle::operator=(const Particle& other)
+{
+	if (this == &other)
+		return *this;
+
+	sphere = other.sphere;
+	vertices = other.vertices;
+	width = other.width;
+	height = other.height;
+	boundingRadius = other.boundingRadius;
+	localMin = other.localMin;
+	localMax = other.localMax;
+
+	//Copy the values, but keep this particle's own slot
+	setPosition(other.getPosition());
+	setVelocity(other.getVelocity());
+	setAcceleration(other.getAcceleration());
+	store->forceX[index] = other.store->forceX[other.index];
+	store->forceY[index] = other.store->forceY[other.index];
+	store->inverseMass[index] = other.store->inverseMass[other.index];
+	store->radius[index] = other.store->radius[other.index];
+	store->awake[index] = other.store->awake[other.index];
+	store->sleepTime[index] = other.store->sleepTime[other.index];
+
+	return *this;
+}
+
+Particle::~Particle()
+{
+	if (store)
+		store->release(index);
+}
+
+ParticleStore* Particle::getStore() const
+{
+	return store;
+}
+
+unsigned Particle::getStoreIndex() const
+{
+	return index;
+}
+
 void Particle::integrate(float duration)
 {
-	// We don't integrate things with zero mass.
-	if (inverseMass <= 0.0f)
+	float inverseMass = store->inverseMass[index];
+
+	// We don't integrate things with zero mass, or things that are asleep.
+	if (inverseMass <= 0.0f || !isAwake())
 		return;
 
 	assert(duration > 0.0);
-	position.addScaledVector(velocity, duration);
+	store->positionX[index] += store->velocityX[index] * duration;
+	store->positionY[index] += store->velocityY[index] * duration;
 
 	// Work out the acceleration from the force
-	Vector2 resultingAcc = acceleration;
-	resultingAcc.addScaledVector(forceAccum, inverseMass);
+	Vector2 resultingAcc = getAcceleration();
+	resultingAcc.addScaledVector(Vector2(store->forceX[index], store->forceY[index]), inverseMass);
 
 	// Update linear velocity from the acceleration.
-	velocity.addScaledVector(resultingAcc, duration);
+	store->velocityX[index] += resultingAcc.x * duration;
+	store->velocityY[index] += resultingAcc.y * duration;
 
 	//velocity *= pow(0.9f, duration);
 	//velocity *= 0.95;
@@ -39,16 +143,41 @@ void Particle::setVertices(std::vector<Vector2>& vertices)
 		Particle::vertices[i].x = vertices[i].x;
 		Particle::vertices[i].y = vertices[i].y;
 	}
+
+	//Update the bounding volumes to fit the new vertices. With no vertices there is nothing
+	//to fit, so fall back to the bounds of the radius
+	if (vertices.empty())
+	{
+		float r = getRadius();
+		boundingRadius = r;
+		localMin = Vector2(-r, -r);
+		localMax = Vector2(r, r);
+		return;
+	}
+
+	boundingRadius = 0;
+	localMin = localMax = vertices[0];
+
+	for (int i = 0; i < vertices.size(); i++)
+	{
+		float squareDistance = vertices[i].squareMagnitude();
+		if (squareDistance > boundingRadius)
+			boundingRadius = squareDistance;
+
+		if (vertices[i].x < localMin.x) localMin.x = vertices[i].x;
+		if (vertices[i].y < localMin.y) localMin.y = vertices[i].y;
+		if (vertices[i].x > localMax.x) localMax.x = vertices[i].x;
+		if (vertices[i].y > localMax.y) localMax.y = vertices[i].y;
+	}
+
+	boundingRadius = sqrt(boundingRadius);
 }
 
 //Returns the vertices of the shape
-//If shape is a sphere, an empty vector will be returned
+//If shape is a sphere, an empty vector will be returned (spheres never have vertices set)
 std::vector<Vector2>& Particle::getVertices()
 {
-	if (!sphere)
-		return vertices;
-	else
-		return std::vector<Vector2>();
+	return vertices;
 }
 
 void Particle::setWidthAndHeight(float w, float h)
@@ -76,11 +205,13 @@ bool Particle::isSphere()
 void Particle::setMass(const float mass)
 {
 	assert(mass != 0);
-	Particle::inverseMass = ((float)1.0) / mass;
+	store->inverseMass[index] = ((float)1.0) / mass;
 }
 
 float Particle::getMass() const
 {
+	float inverseMass = store->inverseMass[index];
+
 	if (inverseMass == 0) {
 		return DBL_MAX;
 	}
@@ -91,93 +222,156 @@ float Particle::getMass() const
 
 void Particle::setInverseMass(const float inverseMass)
 {
-	Particle::inverseMass = inverseMass;
+	store->inverseMass[index] = inverseMass;
 }
 
 float Particle::getInverseMass() const
 {
-	return inverseMass;
+	return store->inverseMass[index];
 }
 
 bool Particle::hasFiniteMass() const
 {
-	return inverseMass >= 0.0f;
+	return store->inverseMass[index] >= 0.0f;
 }
 
 void Particle::setPosition(const float x, const float y)
 {
-	position.x = x;
-	position.y = y;
+	store->positionX[index] = x;
+	store->positionY[index] = y;
 }
 
 void Particle::setPosition(const Vector2 &position)
 {
-	Particle::position = position;
+	setPosition(position.x, position.y);
 }
 
 Vector2 Particle::getPosition() const
 {
-	return position;
+	return Vector2(store->positionX[index], store->positionY[index]);
 }
 
 void Particle::getPosition(Vector2 *position) const
 {
-	*position = Particle::position;
+	*position = getPosition();
 }
 
 void Particle::setRadius(const float r)
 {
-	radius = r;
+	store->radius[index] = r;
+
+	//A polygon's bounds come from its vertices instead
+	if (sphere || vertices.empty())
+	{
+		boundingRadius = r;
+		localMin = Vector2(-r, -r);
+		localMax = Vector2(r, r);
+	}
 }
 
 float Particle::getRadius() const
 {
-	return radius;
+	return store->radius[index];
+}
+
+float Particle::getBoundingRadius() const
+{
+	return boundingRadius;
+}
+
+void Particle::getBounds(Vector2& min, Vector2& max) const
+{
+	Vector2 position = getPosition();
+
+	min = position + localMin;
+	max = position + localMax;
 }
 
 void Particle::setVelocity(const float x, const float y)
 {
-	velocity.x = x;
-	velocity.y = y;
+	store->velocityX[index] = x;
+	store->velocityY[index] = y;
+
+	if (x != 0 || y != 0)
+		setAwake();
 }
 
 void Particle::setVelocity(const Vector2 &velocity)
 {
-	Particle::velocity = velocity;
+	setVelocity(velocity.x, velocity.y);
 }
 
 Vector2 Particle::getVelocity() const
 {
-	return velocity;
+	return Vector2(store->velocityX[index], store->velocityY[index]);
 }
 
 void Particle::getVelocity(Vector2 *velocity) const
 {
-	*velocity = Particle::velocity;
+	*velocity = getVelocity();
 }
 
 void Particle::setAcceleration(const Vector2 &acceleration)
 {
-	Particle::acceleration = acceleration;
+	setAcceleration(acceleration.x, acceleration.y);
 }
 
 void Particle::setAcceleration(const float x, const float y)
 {
-	acceleration.x = x;
-	acceleration.y = y;
+	store->accelerationX[index] = x;
+	store->accelerationY[index] = y;
 }
 
 Vector2 Particle::getAcceleration() const
 {
-	return acceleration;
+	return Vector2(store->accelerationX[index], store->accelerationY[index]);
 }
 
 void Particle::clearAccumulator()
 {
-	forceAccum.clear();
+	store->forceX[index] = 0;
+	store->forceY[index] = 0;
 }
 
 void Particle::addForce(const Vector2 &force)
 {
-	forceAccum += force;
-}
\ No newline at end of file
+	store->forceX[index] += force.x;
+	store->forceY[index] += force.y;
+
+	if (force.x != 0 || force.y != 0)
+		setAwake();
+}
+
+bool Particle::isAwake() const
+{
+	return store->awake[index] > 0;
+}
+
+void Particle::setAwake(const bool awake)
+{
+	if (awake)
+	{
+		//Waking a particle that is already awake leaves its sleep time alone
+		if (isAwake())
+			return;
+
+		store->awake[index] = 1;
+		store->sleepTime[index] = 0;
+	}
+	else
+	{
+		store->awake[index] = 0;
+		store->velocityX[index] = store->velocityY[index] = 0;
+		clearAccumulator();
+	}
+}
+
+float Particle::getSleepTime() const
+{
+	return store->sleepTime[index];
+}
+
+void Particle::setSleepTime(const float time)
+{
+	store->sleepTime[index] = time;
+}
@@ -0,0 +1,148 @@
+#include <math.h>
+#include <pbroadphase.h>
+
+void ParticleBroadphase::calcBounds(Particle& particle, Vector2& min, Vector2& max)
+{
+	particle.getBounds(min, max);
+}
+
+ParticleGridBroadphase::ParticleGridBroadphase(float cellSize)
+	:
+	cellSize(cellSize),
+	usedCellSize(cellSize)
+{
+}
+
+void ParticleGridBroadphase::setCellSize(float cellSize)
+{
+	ParticleGridBroadphase::cellSize = cellSize;
+}
+
+float ParticleGridBroadphase::getCellSize() const
+{
+	return usedCellSize;
+}
+
+unsigned ParticleGridBroadphase::hashCell(int cellX, int cellY, unsigned mask) const
+{
+	//Large primes spread neighbouring cells across the table
+	return ((unsigned)cellX * 73856093u ^ (unsigned)cellY * 19349663u) & mask;
+}
+
+void ParticleGridBroadphase::update(Particle* particles, unsigned count)
+{
+	pairs.clear();
+
+	if (count < 2)
+		return;
+
+	mins.resize(count);
+	maxs.resize(count);
+
+	//Work out the bounds of every particle, and the largest extent of any of them
+	float largestExtent = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		calcBounds(particles[i], mins[i], maxs[i]);
+
+		float extentX = maxs[i].x - mins[i].x;
+		float extentY = maxs[i].y - mins[i].y;
+
+		if (extentX > largestExtent) largestExtent = extentX;
+		if (extentY > largestExtent) largestExtent = extentY;
+	}
+
+	//With the cell as big as the biggest particle, no particle can cover more than 4 cells
+	usedCellSize = cellSize > 0 ? cellSize : largestExtent;
+	if (usedCellSize <= 0)
+		usedCellSize = 1;
+
+	float inverseCellSize = 1.0f / usedCellSize;
+
+	//Add an entry for every cell that each particle overlaps
+	entries.clear();
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		int minX = (int)floorf(mins[i].x * inverseCellSize);
+		int minY = (int)floorf(mins[i].y * inverseCellSize);
+		int maxX = (int)floorf(maxs[i].x * inverseCellSize);
+		int maxY = (int)floorf(maxs[i].y * inverseCellSize);
+
+		for (int x = minX; x <= maxX; x++)
+			for (int y = minY; y <= maxY; y++)
+			{
+				CellEntry entry = { x, y, i };
+				entries.push_back(entry);
+			}
+	}
+
+	//Counting sort the entries into a hash table with at least as many buckets as entries
+	unsigned tableSize = 1;
+	while (tableSize < entries.size())
+		tableSize <<= 1;
+	unsigned mask = tableSize - 1;
+
+	bucketStart.assign(tableSize + 1, 0);
+
+	for (unsigned i = 0; i < entries.size(); i++)
+		bucketStart[hashCell(entries[i].cellX, entries[i].cellY, mask) + 1]++;
+
+	for (unsigned i = 0; i < tableSize; i++)
+		bucketStart[i + 1] += bucketStart[i];
+
+	buckets.resize(entries.size());
+
+	for (unsigned i = 0; i < entries.size(); i++)
+	{
+		unsigned bucket = hashCell(entries[i].cellX, entries[i].cellY, mask);
+		buckets[bucketStart[bucket]++] = entries[i];
+	}
+
+	//The scatter above moved each start to the end of its bucket, so shift them back
+	for (unsigned i = tableSize; i > 0; i--)
+		bucketStart[i] = bucketStart[i - 1];
+	bucketStart[0] = 0;
+
+	//Test the particles that share each cell against each other
+	for (unsigned bucket = 0; bucket < tableSize; bucket++)
+	{
+		unsigned end = bucketStart[bucket + 1];
+
+		for (unsigned a = bucketStart[bucket]; a < end; a++)
+		{
+			const CellEntry& entryA = buckets[a];
+
+			for (unsigned b = a + 1; b < end; b++)
+			{
+				const CellEntry& entryB = buckets[b];
+
+				//Different cells can hash to the same bucket
+				if (entryA.cellX != entryB.cellX || entryA.cellY != entryB.cellY)
+					continue;
+
+				unsigned i = entryA.particle;
+				unsigned j = entryB.particle;
+
+				if (maxs[i].x < mins[j].x || maxs[j].x < mins[i].x ||
+					maxs[i].y < mins[j].y || maxs[j].y < mins[i].y)
+					continue;
+
+				//Two particles can share several cells. Only report the pair from the cell
+				//that holds the lowest corner of their overlap, so that it is reported once.
+				float overlapX = mins[i].x > mins[j].x ? mins[i].x : mins[j].x;
+				float overlapY = mins[i].y > mins[j].y ? mins[i].y : mins[j].y;
+
+				if ((int)floorf(overlapX * inverseCellSize) != entryA.cellX ||
+					(int)floorf(overlapY * inverseCellSize) != entryA.cellY)
+					continue;
+
+				ParticlePair pair;
+				pair.first = i < j ? i : j;
+				pair.second = i < j ? j : i;
+				pairs.push_back(pair);
+			}
+		}
+	}
+}
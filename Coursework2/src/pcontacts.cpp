@@ -1,5 +1,11 @@
 #include <float.h>
+#include <algorithm>
+#include <limits>
+#include <parena.h>
 #include <pcontacts.h>
+#include <pisland.h>
+#include <pjobs.h>
+#include <ptrace.h>
 
 // Contact implementation
 void ParticleContact::resolve(float duration)
@@ -59,15 +65,12 @@ void ParticleContact::resolveVelocity(float duration)
 			);
 	}
 
-	//resolve inter-penetration by moving two spheres apart from each other by the distance they have inter-penetrated
+	//resolve inter-penetration by moving two particles apart along the contact normal by the distance they have inter-penetrated
 	if (particle[0] && particle[1])
 	{
 		if (penetration > 0)
 		{
-			Vector2 interpenetrationVec = particle[0]->getPosition() - particle[1]->getPosition();
-
-			interpenetrationVec.normalise();
-			interpenetrationVec *= penetration;
+			Vector2 interpenetrationVec = contactNormal * penetration;
 
 			particle[0]->setPosition(particle[0]->getPosition() + interpenetrationVec * 0.5);
 			particle[1]->setPosition(particle[1]->getPosition() - interpenetrationVec * 0.5);
@@ -78,7 +81,12 @@ void ParticleContact::resolveVelocity(float duration)
 
 ParticleContactResolver::ParticleContactResolver(unsigned iterations)
 	:
-	iterations(iterations)
+	iterations(iterations),
+	sequentialImpulses(false),
+	impulseIterations(6),
+	restitutionThreshold(5.0f),
+	jobs(0),
+	deterministic(false)
 {
 }
 
@@ -87,34 +95,538 @@ void ParticleContactResolver::setIterations(unsigned iterations)
 	ParticleContactResolver::iterations = iterations;
 }
 
+void ParticleContactResolver::setSequentialImpulses(bool sequentialImpulses, unsigned impulseIterations)
+{
+	ParticleContactResolver::sequentialImpulses = sequentialImpulses;
+	ParticleContactResolver::impulseIterations = impulseIterations;
+
+	//Totals from the other mode mean nothing
+	impulseCache.clear();
+}
+
+bool ParticleContactResolver::usesSequentialImpulses() const
+{
+	return sequentialImpulses;
+}
+
+void ParticleContactResolver::setRestitutionThreshold(float restitutionThreshold)
+{
+	ParticleContactResolver::restitutionThreshold = restitutionThreshold;
+}
+
+void ParticleContactResolver::setJobSystem(JobSystem* jobs)
+{
+	ParticleContactResolver::jobs = jobs;
+}
+
+void ParticleContactResolver::setDeterministic(bool deterministic)
+{
+	ParticleContactResolver::deterministic = deterministic;
+}
+
+unsigned ParticleContactResolver::getIterationsUsed() const
+{
+	return iterationsUsed;
+}
+
+float ParticleContactResolver::calculateMaxClosingVelocity(const ParticleContact *contactArray, unsigned numContacts)
+{
+	float maxClosingVelocity = 0;
+
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		float closingVelocity = -contactArray[i].calculateSeparatingVelocity();
+		if (closingVelocity > maxClosingVelocity)
+			maxClosingVelocity = closingVelocity;
+	}
+
+	return maxClosingVelocity;
+}
+
+//The key of contacts that do not need resolving, which puts them at the back of the heap
+static const float UNRESOLVED = std::numeric_limits<float>::infinity();
+
+float ParticleContactResolver::calculateKey(const ParticleContact& contact)
+{
+	float sepVel = contact.calculateSeparatingVelocity();
+
+	// Only closing contacts, or those still interpenetrating, are worth resolving
+	if (sepVel < UNRESOLVED && (sepVel < 0 || contact.penetration > 0))
+		return sepVel;
+
+	return UNRESOLVED;
+}
+
+bool ParticleContactResolver::heapBefore(unsigned a, unsigned b) const
+{
+	// Ties go to the earlier contact
+	if (heapKey[a] != heapKey[b])
+		return heapKey[a] < heapKey[b];
+
+	return a < b;
+}
+
+void ParticleContactResolver::heapSiftUp(unsigned position)
+{
+	unsigned contact = heap[position];
+
+	while (position > 0)
+	{
+		unsigned parent = (position - 1) / 2;
+		if (!heapBefore(contact, heap[parent]))
+			break;
+
+		heap[position] = heap[parent];
+		heapPosition[heap[position]] = position;
+		position = parent;
+	}
+
+	heap[position] = contact;
+	heapPosition[contact] = position;
+}
+
+void ParticleContactResolver::heapSiftDown(unsigned position)
+{
+	unsigned contact = heap[position];
+	unsigned count = heap.size();
+
+	while (true)
+	{
+		unsigned child = position * 2 + 1;
+		if (child >= count)
+			break;
+
+		if (child + 1 < count && heapBefore(heap[child + 1], heap[child]))
+			child++;
+
+		if (!heapBefore(heap[child], contact))
+			break;
+
+		heap[position] = heap[child];
+		heapPosition[heap[position]] = position;
+		position = child;
+	}
+
+	heap[position] = contact;
+	heapPosition[contact] = position;
+}
+
+void ParticleContactResolver::updateNeighbours(ParticleContact *contactArray, unsigned contact)
+{
+	for (unsigned end = contact * 2; end < contact * 2 + 2; end++)
+	{
+		for (unsigned i = endBegin[end]; i < endFinish[end]; i++)
+		{
+			unsigned neighbour = ends[i].end / 2;
+
+			float key = calculateKey(contactArray[neighbour]);
+			if (key == heapKey[neighbour])
+				continue;
+
+			bool earlier = key < heapKey[neighbour];
+			heapKey[neighbour] = key;
+
+			if (earlier)
+				heapSiftUp(heapPosition[neighbour]);
+			else
+				heapSiftDown(heapPosition[neighbour]);
+		}
+	}
+}
+
+//The fraction of the overlap beyond the slop that sequential impulses correct each frame
+static const float POSITION_CORRECTION = 0.4f;
+
+//The overlap sequential impulses leave alone, so that resting contacts are found again next frame
+static const float PENETRATION_SLOP = 0.1f;
+
+//The number of contacts of a colour each thread solves at a time
+static const unsigned COLOUR_GRAIN = 256;
+
+void ParticleContactResolver::applyImpulse(ParticleContact& contact, float impulse)
+{
+	Vector2 impulsePerIMass = contact.contactNormal * impulse;
+
+	if (contact.particle[0]->getInverseMass() > 0)
+		contact.particle[0]->setVelocity(contact.particle[0]->getVelocity() +
+			impulsePerIMass * contact.particle[0]->getInverseMass());
+
+	if (contact.particle[1] && contact.particle[1]->getInverseMass() > 0)
+		contact.particle[1]->setVelocity(contact.particle[1]->getVelocity() +
+			impulsePerIMass * -contact.particle[1]->getInverseMass());
+}
+
+void ParticleContactResolver::solveImpulse(ParticleContact& contact, ImpulseConstraint& constraint)
+{
+	if (constraint.effectiveMass == 0)
+		return;
+
+	float impulse = (constraint.targetVelocity - contact.calculateSeparatingVelocity()) *
+		constraint.effectiveMass;
+
+	// The total may never pull the particles together
+	float total = constraint.accumulatedImpulse + impulse;
+	if (total < 0) total = 0;
+
+	impulse = total - constraint.accumulatedImpulse;
+	constraint.accumulatedImpulse = total;
+
+	applyImpulse(contact, impulse);
+}
+
+void ParticleContactResolver::solveImpulses(ParticleContact *contactArray, unsigned begin, unsigned end)
+{
+	// Make passes over the contacts, nudging each towards its target velocity
+	for (iterationsUsed = 0; iterationsUsed < impulseIterations; iterationsUsed++)
+		for (unsigned i = begin; i < end; i++)
+			solveImpulse(contactArray[i], constraints[i]);
+}
+
+//Returns the particle if a contact can move it, or NULL
+static Particle* movingParticle(Particle* particle)
+{
+	return particle && particle->getInverseMass() > 0 ? particle : 0;
+}
+
+void ParticleContactResolver::colourContacts(ParticleContact *contactArray, unsigned numContacts)
+{
+	// The colouring only depends on which particles each contact moves,
+	// so if those are the same as last time (and there was a last time)
+	// there is nothing to do
+	bool same = !colourBegin.empty() && colouredEnds.size() == numContacts * 2;
+
+	for (unsigned i = 0; i < numContacts && same; i++)
+		same = colouredEnds[i * 2] == movingParticle(contactArray[i].particle[0]) &&
+			colouredEnds[i * 2 + 1] == movingParticle(contactArray[i].particle[1]);
+
+	if (same)
+		return;
+
+	colouredEnds.resize(numContacts * 2);
+	for (unsigned i = 0; i < numContacts; i++)
+		for (unsigned k = 0; k < 2; k++)
+			colouredEnds[i * 2 + k] = movingParticle(contactArray[i].particle[k]);
+
+	// Number the moving particles
+	colourParticles.clear();
+	reserveGrowing(colourParticles, colouredEnds.size());
+	for (unsigned i = 0; i < colouredEnds.size(); i++)
+		if (colouredEnds[i])
+			colourParticles.push_back(colouredEnds[i]);
+
+	std::sort(colourParticles.begin(), colourParticles.end());
+	colourParticles.erase(std::unique(colourParticles.begin(), colourParticles.end()), colourParticles.end());
+	reserveGrowing(particleColours, colourParticles.size());
+	particleColours.assign(colourParticles.size(), 0);
+
+	// Give each contact the first colour not yet used on either of its particles
+	contactColour.resize(numContacts);
+	colourBegin.assign(MAX_COLOURS + 2, 0);
+
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		unsigned node[2];
+		unsigned long long used = 0;
+
+		for (unsigned k = 0; k < 2; k++)
+		{
+			Particle* particle = colouredEnds[i * 2 + k];
+			if (!particle)
+				continue;
+
+			node[k] = std::lower_bound(colourParticles.begin(), colourParticles.end(), particle) - colourParticles.begin();
+			used |= particleColours[node[k]];
+		}
+
+		unsigned colour = 0;
+		while (colour < MAX_COLOURS && (used & (1ull << colour)))
+			colour++;
+
+		if (colour < MAX_COLOURS)
+			for (unsigned k = 0; k < 2; k++)
+				if (colouredEnds[i * 2 + k])
+					particleColours[node[k]] |= 1ull << colour;
+
+		contactColour[i] = colour;
+		colourBegin[colour + 1]++;
+	}
+
+	// Group the contacts by colour, keeping their order within each
+	for (unsigned c = 0; c <= MAX_COLOURS; c++)
+		colourBegin[c + 1] += colourBegin[c];
+
+	colourOrder.resize(numContacts);
+	colourNext.assign(colourBegin.begin(), colourBegin.end() - 1);
+
+	for (unsigned i = 0; i < numContacts; i++)
+		colourOrder[colourNext[contactColour[i]]++] = i;
+}
+
+void ParticleContactResolver::solveColourRange(void* context, unsigned begin, unsigned end, unsigned)
+{
+	ColourBatch* batch = (ColourBatch*)context;
+
+	for (unsigned i = begin; i < end; i++)
+	{
+		unsigned contact = batch->contacts[i];
+		solveImpulse(batch->contactArray[contact], batch->resolver->constraints[contact]);
+	}
+}
+
+void ParticleContactResolver::solveColouredImpulses(ParticleContact *contactArray)
+{
+	for (iterationsUsed = 0; iterationsUsed < impulseIterations; iterationsUsed++)
+	{
+		PTRACE_ZONE("impulse iteration");
+
+		for (unsigned c = 0; c <= MAX_COLOURS; c++)
+		{
+			unsigned count = colourBegin[c + 1] - colourBegin[c];
+			if (count == 0)
+				continue;
+
+			ColourBatch batch = { this, contactArray, &colourOrder[colourBegin[c]] };
+
+			// The contacts that did not get a colour may share particles, so are solved in turn
+			if (c == MAX_COLOURS || !jobs)
+				solveColourRange(&batch, 0, count, 0);
+			else
+				jobs->parallelFor(count, COLOUR_GRAIN, solveColourRange, &batch);
+		}
+	}
+}
+
+void ParticleContactResolver::resolveImpulses(ParticleContact *contactArray, unsigned numContacts,
+	const ParticleIsland* islands, unsigned numIslands, float)
+{
+	PTRACE_ZONE("ParticleContactResolver::resolveImpulses");
+
+	constraints.resize(numContacts);
+	nextImpulseCache.resize(numContacts);
+
+	// Set up the contacts. This has to be done for all of them before any
+	// impulse is applied, or the velocities they bounce from would be wrong.
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		ParticleContact& contact = contactArray[i];
+		ImpulseConstraint& constraint = constraints[i];
+
+		float totalInverseMass = contact.particle[0]->getInverseMass();
+		if (contact.particle[1]) totalInverseMass += contact.particle[1]->getInverseMass();
+
+		constraint.effectiveMass = totalInverseMass > 0 ? 1.0f / totalInverseMass : 0;
+		constraint.accumulatedImpulse = 0;
+
+		// Only contacts closing quickly bounce
+		float separatingVelocity = contact.calculateSeparatingVelocity();
+		constraint.targetVelocity = separatingVelocity < -restitutionThreshold ?
+			-separatingVelocity * contact.restitution : 0;
+	}
+
+	// Warm start the contacts that carried on from last frame
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		ParticleContact& contact = contactArray[i];
+		ImpulseConstraint& constraint = constraints[i];
+
+		if (constraint.effectiveMass == 0)
+			continue;
+
+		std::vector<CachedImpulse>::iterator cached = std::lower_bound(impulseCache.begin(), impulseCache.end(),
+			CachedImpulse{ contact.pairId, 0 });
+
+		if (cached != impulseCache.end() && cached->pairId == contact.pairId && cached->impulse > 0)
+		{
+			constraint.accumulatedImpulse = cached->impulse;
+			applyImpulse(contact, cached->impulse);
+		}
+	}
+
+	// Spread over several threads, the contacts are solved a colour at a time, and they always
+	// are when the result must not depend on the number of threads
+	if (deterministic || (jobs && jobs->getThreadCount() > 1))
+	{
+		{
+			PTRACE_ZONE("ParticleContactResolver::colourContacts");
+			colourContacts(contactArray, numContacts);
+		}
+		solveColouredImpulses(contactArray);
+	}
+	// Islands share no moving particles, so they can be solved one after another
+	// (there can be thousands of them, each with a few iterations, so they are traced together)
+	else if (islands)
+	{
+		PTRACE_ZONE("solve islands");
+
+		for (unsigned i = 0; i < numIslands; i++)
+			solveImpulses(contactArray, islands[i].contactBegin, islands[i].contactBegin + islands[i].contactCount);
+	}
+	else
+	{
+		PTRACE_ZONE("solve contacts");
+		solveImpulses(contactArray, 0, numContacts);
+	}
+
+	// Correct part of the overlap, sharing the movement by inverse mass
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		ParticleContact& contact = contactArray[i];
+
+		float correction = (contact.penetration - PENETRATION_SLOP) * POSITION_CORRECTION;
+		if (correction <= 0 || constraints[i].effectiveMass == 0)
+			continue;
+
+		Vector2 movePerIMass = contact.contactNormal * (correction * constraints[i].effectiveMass);
+
+		contact.particle[0]->setPosition(contact.particle[0]->getPosition() +
+			movePerIMass * contact.particle[0]->getInverseMass());
+
+		if (contact.particle[1])
+			contact.particle[1]->setPosition(contact.particle[1]->getPosition() -
+				movePerIMass * contact.particle[1]->getInverseMass());
+	}
+
+	// Remember the totals for next frame
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		nextImpulseCache[i].pairId = contactArray[i].pairId;
+		nextImpulseCache[i].impulse = constraints[i].accumulatedImpulse;
+	}
+
+	std::sort(nextImpulseCache.begin(), nextImpulseCache.end());
+	impulseCache.swap(nextImpulseCache);
+}
+
 void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
 	unsigned numContacts,
+	const ParticleIsland* islands,
+	unsigned numIslands,
 	float duration)
 {
-	unsigned i;
+	if (sequentialImpulses)
+	{
+		iterationsUsed = 0;
+		resolveImpulses(contactArray, numContacts, islands, numIslands, duration);
+		return;
+	}
+
+	for (unsigned i = 0; i < numIslands; i++)
+		resolveContacts(contactArray + islands[i].contactBegin, islands[i].contactCount, duration);
+}
 
+void ParticleContactResolver::resolveContacts(ParticleContact *contactArray,
+	unsigned numContacts,
+	float duration)
+{
 	iterationsUsed = 0;
-	while (iterationsUsed < iterations)
+
+	if (sequentialImpulses)
 	{
-		// Find the contact with the largest closing velocity;
-		float max = DBL_MAX;
-		unsigned maxIndex = numContacts;
-		for (i = 0; i < numContacts; i++)
-		{
-			float sepVel = contactArray[i].calculateSeparatingVelocity();
-			if (sepVel < max && (sepVel < 0 || contactArray[i].penetration > 0))
+		resolveImpulses(contactArray, numContacts, 0, 0, duration);
+		return;
+	}
+
+	if (numContacts == 0 || iterations == 0)
+		return;
+
+	// Sort the ends of the contacts by particle, so that the contacts
+	// sharing a particle can be found from any one of them
+	ends.clear();
+	reserveGrowing(ends, numContacts * 2);
+	reserveGrowing(endBegin, numContacts * 2);
+	reserveGrowing(endFinish, numContacts * 2);
+	endBegin.assign(numContacts * 2, 0);
+	endFinish.assign(numContacts * 2, 0);
+
+	for (unsigned i = 0; i < numContacts; i++)
+		for (unsigned k = 0; k < 2; k++)
+			if (contactArray[i].particle[k])
 			{
-				max = sepVel;
-				maxIndex = i;
+				ContactEnd end = { contactArray[i].particle[k], i * 2 + k };
+				ends.push_back(end);
 			}
+
+	std::sort(ends.begin(), ends.end());
+
+	for (unsigned begin = 0; begin < ends.size();)
+	{
+		unsigned finish = begin + 1;
+		while (finish < ends.size() && ends[finish].particle == ends[begin].particle)
+			finish++;
+
+		for (unsigned i = begin; i < finish; i++)
+		{
+			endBegin[ends[i].end] = begin;
+			endFinish[ends[i].end] = finish;
 		}
+
+		begin = finish;
+	}
+
+	// Build the heap
+	heap.resize(numContacts);
+	heapPosition.resize(numContacts);
+	heapKey.resize(numContacts);
+
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		heap[i] = i;
+		heapPosition[i] = i;
+		heapKey[i] = calculateKey(contactArray[i]);
+	}
+
+	for (unsigned i = numContacts / 2; i > 0; i--)
+		heapSiftDown(i - 1);
+
+	// The iterations each resolve one contact, so are traced together
+	PTRACE_ZONE("ParticleContactResolver::resolveContacts");
+
+	while (iterationsUsed < iterations)
+	{
+		// Find the contact with the largest closing velocity;
+		unsigned maxIndex = heap[0];
+
 		//Do we have anything worth resolving?
-		if (maxIndex == numContacts) break;
+		if (heapKey[maxIndex] == UNRESOLVED) break;
 
 		// Resolve this contact
 		contactArray[maxIndex].resolve(duration);
 
+		// Only the contacts sharing one of its particles have changed
+		updateNeighbours(contactArray, maxIndex);
+
 		iterationsUsed++;
 	}
+}
+
+ParticleContactOverflow::ParticleContactOverflow()
+	:
+	taken(0)
+{
+}
 
-}
\ No newline at end of file
+void ParticleContactOverflow::clear()
+{
+	contacts.clear();
+	taken = 0;
+}
+
+void ParticleContactOverflow::add(const ParticleContact& contact)
+{
+	contacts.push_back(contact);
+}
+
+unsigned ParticleContactOverflow::getCount() const
+{
+	return (unsigned)contacts.size() - taken;
+}
+
+unsigned ParticleContactOverflow::take(ParticleContact *contact, unsigned limit)
+{
+	unsigned count = 0;
+
+	while (count < limit && taken < contacts.size())
+		contact[count++] = contacts[taken++];
+
+	return count;
+}
@@ -0,0 +1,127 @@
+#include <pfgen.h>
+
+bool ParticleForceGenerator::addBatchTerms(ParticleForceTerms&) const
+{
+	return false;
+}
+
+void ParticleForceRegistry::add(Particle* particle, ParticleForceGenerator* fg)
+{
+	ParticleForceRegistration registration;
+	registration.particle = particle;
+	registration.fg = fg;
+	registrations.push_back(registration);
+}
+
+void ParticleForceRegistry::remove(Particle* particle, ParticleForceGenerator* fg)
+{
+	for (Registry::iterator i = registrations.begin(); i != registrations.end(); i++)
+	{
+		if (i->particle == particle && i->fg == fg)
+		{
+			registrations.erase(i);
+			return;
+		}
+	}
+}
+
+void ParticleForceRegistry::clear()
+{
+	registrations.clear();
+}
+
+void ParticleForceRegistry::updateForces(float duration)
+{
+	for (Registry::iterator i = registrations.begin(); i != registrations.end(); i++)
+		i->fg->updateForce(i->particle, duration);
+}
+
+ParticleGravity::ParticleGravity(const Vector2& gravity)
+	:
+	gravity(gravity)
+{
+}
+
+void ParticleGravity::updateForce(Particle* particle, float)
+{
+	// Check that we do not have infinite mass
+	if (particle->getInverseMass() <= 0.0f)
+		return;
+
+	// Apply the mass-scaled force to the particle
+	particle->addForce(gravity * particle->getMass());
+}
+
+bool ParticleGravity::addBatchTerms(ParticleForceTerms& terms) const
+{
+	terms.gravityX += gravity.x;
+	terms.gravityY += gravity.y;
+	return true;
+}
+
+ParticleDrag::ParticleDrag(float k0, float k1, float k2)
+	:
+	k0(k0), k1(k1), k2(k2)
+{
+}
+
+void ParticleDrag::updateForce(Particle* particle, float)
+{
+	if (particle->getInverseMass() <= 0.0f)
+		return;
+
+	Vector2 force = particle->getVelocity();
+
+	// Calculate the total drag coefficient
+	float speed = force.magnitude();
+	if (speed <= 0)
+		return;
+
+	float dragCoeff = k0 + k1 * speed + k2 * speed * speed;
+
+	// Calculate the final force and apply it
+	force *= -dragCoeff / speed;
+	particle->addForce(force);
+}
+
+bool ParticleDrag::addBatchTerms(ParticleForceTerms& terms) const
+{
+	terms.drag0 += k0;
+	terms.drag1 += k1;
+	terms.drag2 += k2;
+	return true;
+}
+
+ParticleSpring::ParticleSpring(Particle* other, float springConstant, float restLength)
+	:
+	other(other), springConstant(springConstant), restLength(restLength)
+{
+}
+
+void ParticleSpring::updateForce(Particle* particle, float)
+{
+	// Calculate the vector of the spring
+	Vector2 force = particle->getPosition() - other->getPosition();
+
+	// Calculate the magnitude of the force
+	float length = force.magnitude();
+	if (length <= 0)
+		return;
+
+	float magnitude = (length - restLength) * springConstant;
+
+	// Calculate the final force and apply it
+	force *= -magnitude / length;
+	particle->addForce(force);
+}
+
+ParticleForceCallback::ParticleForceCallback(Callback callback, void* data)
+	:
+	callback(callback), data(data)
+{
+}
+
+void ParticleForceCallback::updateForce(Particle* particle, float duration)
+{
+	callback(particle, duration, data);
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <parena.h>
+#include <pisland.h>
+#include <ptrace.h>
+
+static const unsigned NO_ISLAND = 0xffffffffu;
+
+//Only particles that contacts can move link contacts together
+static bool isMoving(const Particle* particle)
+{
+	return particle && particle->getInverseMass() > 0;
+}
+
+unsigned ParticleIslands::findNode(Particle* particle) const
+{
+	return std::lower_bound(nodes.begin(), nodes.end(), particle) - nodes.begin();
+}
+
+unsigned ParticleIslands::findRoot(unsigned node)
+{
+	//Halve the path on the way up, so later searches are shorter
+	while (parent[node] != node)
+	{
+		parent[node] = parent[parent[node]];
+		node = parent[node];
+	}
+
+	return node;
+}
+
+void ParticleIslands::join(unsigned a, unsigned b)
+{
+	a = findRoot(a);
+	b = findRoot(b);
+
+	//The lower node becomes the root, so the result does not depend on the order of joining
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+void ParticleIslands::build(ParticleContact *contactArray, unsigned numContacts)
+{
+	PTRACE_ZONE("ParticleIslands::build");
+
+	islands.clear();
+	islandParticles.clear();
+
+	if (numContacts == 0)
+		return;
+
+	//There are at most two particles and one island per contact. Making room for that many up
+	//front means the lists only grow when the number of contacts does.
+	reserveGrowing(nodes, numContacts * 2);
+	reserveGrowing(islands, numContacts);
+	reserveGrowing(islandParticles, numContacts * 2);
+
+	//Number the particles in the contacts
+	nodes.clear();
+
+	for (unsigned i = 0; i < numContacts; i++)
+		for (unsigned k = 0; k < 2; k++)
+			if (contactArray[i].particle[k])
+				nodes.push_back(contactArray[i].particle[k]);
+
+	std::sort(nodes.begin(), nodes.end());
+	nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+	parent.resize(nodes.size());
+	for (unsigned i = 0; i < parent.size(); i++)
+		parent[i] = i;
+
+	//Join the moving particles at either end of each contact
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		ParticleContact& contact = contactArray[i];
+
+		if (isMoving(contact.particle[0]) && isMoving(contact.particle[1]))
+			join(findNode(contact.particle[0]), findNode(contact.particle[1]));
+	}
+
+	//Number the islands in the order their first contact comes in. A contact belongs to the island
+	//of its moving particle, or if it has none, is an island on its own.
+	contactIsland.resize(numContacts);
+	reserveGrowing(rootIsland, nodes.size());
+	rootIsland.assign(nodes.size(), NO_ISLAND);
+
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		ParticleContact& contact = contactArray[i];
+		Particle* particle = isMoving(contact.particle[0]) || !isMoving(contact.particle[1]) ?
+			contact.particle[0] : contact.particle[1];
+
+		unsigned island;
+
+		if (isMoving(particle))
+		{
+			unsigned root = findRoot(findNode(particle));
+
+			if (rootIsland[root] == NO_ISLAND)
+			{
+				rootIsland[root] = islands.size();
+				islands.push_back(ParticleIsland());
+				islands.back().contactCount = 0;
+				islands.back().particleCount = 0;
+			}
+
+			island = rootIsland[root];
+		}
+		else
+		{
+			island = islands.size();
+			islands.push_back(ParticleIsland());
+			islands.back().contactCount = 0;
+			islands.back().particleCount = 0;
+		}
+
+		contactIsland[i] = island;
+		islands[island].contactCount++;
+	}
+
+	//Count the moving particles in each island
+	nodeIsland.resize(nodes.size());
+
+	for (unsigned n = 0; n < nodes.size(); n++)
+	{
+		nodeIsland[n] = isMoving(nodes[n]) ? rootIsland[findRoot(n)] : NO_ISLAND;
+
+		if (nodeIsland[n] != NO_ISLAND)
+			islands[nodeIsland[n]].particleCount++;
+	}
+
+	//Work out where each island's ranges start
+	unsigned contactBegin = 0;
+	unsigned particleBegin = 0;
+
+	for (unsigned i = 0; i < islands.size(); i++)
+	{
+		islands[i].contactBegin = contactBegin;
+		islands[i].particleBegin = particleBegin;
+		contactBegin += islands[i].contactCount;
+		particleBegin += islands[i].particleCount;
+	}
+
+	//Sort the contacts and particles into their islands, keeping their order within each
+	sorted.resize(numContacts);
+	islandParticles.resize(particleBegin);
+
+	for (unsigned i = 0; i < islands.size(); i++)
+	{
+		islands[i].contactCount = 0;
+		islands[i].particleCount = 0;
+	}
+
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		ParticleIsland& island = islands[contactIsland[i]];
+		sorted[island.contactBegin + island.contactCount++] = contactArray[i];
+	}
+
+	for (unsigned n = 0; n < nodes.size(); n++)
+	{
+		if (nodeIsland[n] == NO_ISLAND)
+			continue;
+
+		ParticleIsland& island = islands[nodeIsland[n]];
+		islandParticles[island.particleBegin + island.particleCount++] = nodes[n];
+	}
+
+	std::copy(sorted.begin(), sorted.end(), contactArray);
+}
+
+const std::vector<ParticleIsland>& ParticleIslands::getIslands() const
+{
+	return islands;
+}
+
+const std::vector<Particle*>& ParticleIslands::getParticles() const
+{
+	return islandParticles;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <pjobs.h>
+#include <ptrace.h>
+
+JobSystem::JobSystem(unsigned threadCount)
+	:
+	pending(0),
+	generation(0),
+	quit(false)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	for (unsigned i = 0; i < threadCount; i++)
+		queues.push_back(new TaskQueue);
+
+	//The calling thread is thread 0, so only the others need starting
+	for (unsigned i = 1; i < threadCount; i++)
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		quit = true;
+	}
+	wakeCondition.notify_all();
+
+	for (unsigned i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	for (unsigned i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+unsigned JobSystem::getThreadCount() const
+{
+	return queues.size();
+}
+
+bool JobSystem::takeTask(unsigned thread, Task& task)
+{
+	//Work from the front of our own queue
+	{
+		TaskQueue& own = *queues[thread];
+		std::lock_guard<std::mutex> lock(own.mutex);
+
+		if (own.head < own.tasks.size())
+		{
+			task = own.tasks[own.head++];
+			return true;
+		}
+	}
+
+	//Then steal from the back of the others', starting with the next thread along
+	for (unsigned i = 1; i < queues.size(); i++)
+	{
+		TaskQueue& other = *queues[(thread + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+
+		if (other.head < other.tasks.size())
+		{
+			task = other.tasks.back();
+			other.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::runTasks(unsigned thread)
+{
+	Task task;
+
+	while (takeTask(thread, task))
+	{
+		PTRACE_ZONE("JobSystem task");
+
+		task.function(task.context, task.begin, task.end, thread);
+		pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+void JobSystem::workerLoop(unsigned thread)
+{
+	unsigned seen = 0;
+
+	char name[32];
+	snprintf(name, sizeof(name), "JobSystem worker %u", thread);
+	Tracer::setThreadName(name);
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wakeCondition.wait(lock, [&] { return quit || generation != seen; });
+
+			if (quit)
+				return;
+
+			seen = generation;
+		}
+
+		runTasks(thread);
+	}
+}
+
+void JobSystem::parallelFor(unsigned count, unsigned grainSize, RangeFunction function, void* context)
+{
+	if (count == 0)
+		return;
+
+	unsigned threads = queues.size();
+
+	if (grainSize == 0)
+		grainSize = (count + threads - 1) / threads;
+
+	//With one thread, or one chunk, there is nothing to share
+	if (threads == 1 || count <= grainSize)
+	{
+		function(context, 0, count, 0);
+		return;
+	}
+
+	//Deal the chunks out to the threads' queues in turn. The last loop emptied them all.
+	unsigned chunks = (count + grainSize - 1) / grainSize;
+	pending.store(chunks, std::memory_order_release);
+
+	for (unsigned i = 0; i < threads; i++)
+	{
+		std::lock_guard<std::mutex> lock(queues[i]->mutex);
+		queues[i]->tasks.clear();
+		queues[i]->head = 0;
+	}
+
+	for (unsigned chunk = 0; chunk < chunks; chunk++)
+	{
+		Task task;
+		task.function = function;
+		task.context = context;
+		task.begin = chunk * grainSize;
+		task.end = task.begin + grainSize < count ? task.begin + grainSize : count;
+
+		TaskQueue& queue = *queues[chunk % threads];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	//Join in, then wait for the chunks other threads are still running
+	runTasks(0);
+
+	while (pending.load(std::memory_order_acquire) != 0)
+		std::this_thread::yield();
+}
@@ -0,0 +1,345 @@
+#include <math.h>
+#include <pnarrow.h>
+
+//Limits the number of GJK iterations. GJK normally finishes in a handful; this only
+//catches the shapes touching exactly, or curved shapes, where it can keep making tiny progress.
+//Shapes that have not been shown to overlap by then are taken not to.
+static const unsigned MAX_GJK_ITERATIONS = 32;
+
+//EPA stops once a new support point improves on the closest edge by less than this
+static const float EPA_TOLERANCE = 0.0001f;
+
+//The single vertex of a sphere, at its centre
+static const Vector2 CENTRE[1] = { Vector2(0, 0) };
+
+void ConvexShape::setParticle(Particle& particle)
+{
+	position = particle.getPosition();
+
+	if (particle.isSphere())
+	{
+		vertices = CENTRE;
+		count = 1;
+		radius = particle.getRadius();
+	}
+	else
+	{
+		std::vector<Vector2>& particleVertices = particle.getVertices();
+		radius = 0;
+
+		//A polygon without any vertices yet is only a point
+		if (particleVertices.empty())
+		{
+			vertices = CENTRE;
+			count = 1;
+			return;
+		}
+
+		vertices = &particleVertices[0];
+		count = particleVertices.size();
+	}
+}
+
+Vector2 ConvexShape::support(const Vector2& direction) const
+{
+	unsigned best = 0;
+	float bestDistance = vertices[0] * direction;
+
+	for (unsigned i = 1; i < count; i++)
+	{
+		float distance = vertices[i] * direction;
+
+		if (distance > bestDistance)
+		{
+			bestDistance = distance;
+			best = i;
+		}
+	}
+
+	Vector2 point = position + vertices[best];
+
+	//The furthest point of a circle is one radius along the direction
+	if (radius > 0)
+		point.addScaledVector(direction.unit(), radius);
+
+	return point;
+}
+
+//Returns the point of the Minkowski difference a - b that is furthest in the given direction
+static Vector2 supportDifference(const ConvexShape& a, const ConvexShape& b, const Vector2& direction)
+{
+	return a.support(direction) - b.support(direction * -1);
+}
+
+//Returns a vector at right angles to the edge, on the same side of it as the given vector
+static Vector2 perpendicularTowards(const Vector2& edge, const Vector2& towards)
+{
+	Vector2 perpendicular(-edge.y, edge.x);
+
+	if (perpendicular * towards < 0)
+		perpendicular.invert();
+
+	return perpendicular;
+}
+
+//Reduces the simplex to the part nearest the origin and picks the next direction to search.
+//The newest point is always last. Returns true if the simplex contains the origin.
+static bool updateSimplex(Vector2 simplex[3], unsigned& simplexCount, Vector2& direction)
+{
+	Vector2 a = simplex[simplexCount - 1];
+	Vector2 toOrigin = a * -1;
+
+	if (simplexCount == 2)
+	{
+		Vector2 ab = simplex[0] - a;
+
+		if (ab * toOrigin > 0)
+		{
+			direction = perpendicularTowards(ab, toOrigin);
+
+			//The origin lies on the line, so the shapes are just touching
+			if (direction * toOrigin == 0)
+				return true;
+		}
+		else
+		{
+			simplex[0] = a;
+			simplexCount = 1;
+			direction = toOrigin;
+		}
+
+		return false;
+	}
+
+	Vector2 b = simplex[1];
+	Vector2 c = simplex[0];
+	Vector2 ab = b - a;
+	Vector2 ac = c - a;
+
+	//Normals of the two edges that meet at the newest point, facing out of the triangle
+	Vector2 abNormal = perpendicularTowards(ab, ac * -1);
+	Vector2 acNormal = perpendicularTowards(ac, ab * -1);
+
+	if (abNormal * toOrigin > 0)
+	{
+		//The origin is beyond edge ab, so drop c
+		simplex[0] = b;
+		simplex[1] = a;
+		simplexCount = 2;
+		direction = abNormal;
+		return false;
+	}
+
+	if (acNormal * toOrigin > 0)
+	{
+		//The origin is beyond edge ac, so drop b
+		simplex[1] = a;
+		simplexCount = 2;
+		direction = acNormal;
+		return false;
+	}
+
+	return true;
+}
+
+bool ConvexCollision::gjk(const ConvexShape& a, const ConvexShape& b, Vector2 simplex[3], unsigned& simplexCount)
+{
+	Vector2 direction = a.position - b.position;
+	if (direction.squareMagnitude() == 0)
+		direction = Vector2(1, 0);
+
+	simplex[0] = supportDifference(a, b, direction);
+	simplexCount = 1;
+	direction = simplex[0] * -1;
+
+	for (unsigned iteration = 0; iteration < MAX_GJK_ITERATIONS; iteration++)
+	{
+		//The origin is on the simplex
+		if (direction.squareMagnitude() == 0)
+			return true;
+
+		Vector2 point = supportDifference(a, b, direction);
+
+		//The furthest we can get towards the origin falls short of it, so it is outside the difference
+		if (point * direction < 0)
+			return false;
+
+		simplex[simplexCount++] = point;
+
+		if (updateSimplex(simplex, simplexCount, direction))
+			return true;
+	}
+
+	//The simplex never enclosed the origin, so it is no use to EPA
+	return false;
+}
+
+void ConvexCollision::epa(const ConvexShape& a, const ConvexShape& b, const Vector2 simplex[3], unsigned simplexCount,
+	Vector2& normal, float& penetration)
+{
+	//Shapes that only touch leave GJK with less than a triangle, and do not penetrate
+	normal = (a.position - b.position).unit();
+	penetration = 0;
+
+	if (simplexCount < 3)
+		return;
+
+	Vector2 polytope[MAX_POLYTOPE];
+	unsigned count = 3;
+
+	//Wind the triangle anticlockwise, so that (y, -x) faces out of each edge
+	float winding = (simplex[1] - simplex[0]).x * (simplex[2] - simplex[0]).y -
+		(simplex[1] - simplex[0]).y * (simplex[2] - simplex[0]).x;
+
+	if (winding == 0)
+		return;
+
+	polytope[0] = simplex[0];
+	polytope[1] = winding > 0 ? simplex[1] : simplex[2];
+	polytope[2] = winding > 0 ? simplex[2] : simplex[1];
+
+	while (true)
+	{
+		//Find the edge of the polytope closest to the origin
+		unsigned closest = 0;
+		float closestDistance = 0;
+		Vector2 closestNormal;
+		bool found = false;
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			Vector2 edge = polytope[(i + 1) % count] - polytope[i];
+			if (edge.squareMagnitude() == 0)
+				continue;
+
+			Vector2 edgeNormal = Vector2(edge.y, -edge.x).unit();
+			float distance = edgeNormal * polytope[i];
+
+			if (!found || distance < closestDistance)
+			{
+				closest = i;
+				closestDistance = distance;
+				closestNormal = edgeNormal;
+				found = true;
+			}
+		}
+
+		if (!found)
+			return;
+
+		//If the difference does not extend past that edge, it is the boundary
+		Vector2 point = supportDifference(a, b, closestNormal);
+		float pointDistance = point * closestNormal;
+
+		if (pointDistance - closestDistance <= EPA_TOLERANCE * (closestDistance > 1 ? closestDistance : 1) ||
+			count == MAX_POLYTOPE)
+		{
+			//a has to move against the boundary's normal to leave b
+			normal = closestNormal * -1;
+			penetration = closestDistance;
+			return;
+		}
+
+		//Otherwise split the edge at the new point
+		for (unsigned i = count; i > closest + 1; i--)
+			polytope[i] = polytope[i - 1];
+
+		polytope[closest + 1] = point;
+		count++;
+	}
+}
+
+bool ConvexCollision::circlePolygon(const Vector2& centre, float radius, const ConvexShape& polygon,
+	Vector2& normal, float& penetration)
+{
+	const Vector2* vertices = polygon.vertices;
+	unsigned count = polygon.count;
+
+	//Work in the polygon's space
+	Vector2 local = centre - polygon.position;
+
+	//Find the winding of the polygon so that edge normals can be made to point outwards
+	float area = 0;
+	for (unsigned i = 0, j = count - 1; i < count; j = i++)
+		area += vertices[j].x * vertices[i].y - vertices[i].x * vertices[j].y;
+	float winding = area >= 0 ? 1.0f : -1.0f;
+
+	//Find the edge the centre is furthest outside of (or least inside of)
+	unsigned bestEdge = 0;
+	float bestSeparation = 0;
+	Vector2 bestNormal;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		Vector2 edge = vertices[(i + 1) % count] - vertices[i];
+		Vector2 edgeNormal = (Vector2(edge.y, -edge.x) * winding).unit();
+		float separation = edgeNormal * (local - vertices[i]);
+
+		//The circle is entirely outside this edge
+		if (separation > radius)
+			return false;
+
+		if (i == 0 || separation > bestSeparation)
+		{
+			bestEdge = i;
+			bestSeparation = separation;
+			bestNormal = edgeNormal;
+		}
+	}
+
+	//The centre is inside the polygon, so push it out through the nearest edge
+	if (bestSeparation <= 0)
+	{
+		normal = bestNormal;
+		penetration = radius - bestSeparation;
+		return true;
+	}
+
+	//Otherwise the closest feature is that edge or one of its ends
+	Vector2 v1 = vertices[bestEdge];
+	Vector2 v2 = vertices[(bestEdge + 1) % count];
+
+	Vector2 corner;
+	bool nearCorner = false;
+
+	if ((local - v1) * (v2 - v1) <= 0)
+	{
+		corner = v1;
+		nearCorner = true;
+	}
+	else if ((local - v2) * (v1 - v2) <= 0)
+	{
+		corner = v2;
+		nearCorner = true;
+	}
+
+	if (nearCorner)
+	{
+		Vector2 fromCorner = local - corner;
+		float squareDistance = fromCorner.squareMagnitude();
+
+		if (squareDistance > radius * radius)
+			return false;
+
+		float distance = sqrt(squareDistance);
+		normal = distance > 0 ? fromCorner * (1.0f / distance) : bestNormal;
+		penetration = radius - distance;
+		return true;
+	}
+
+	normal = bestNormal;
+	penetration = radius - bestSeparation;
+	return true;
+}
+
+bool ConvexCollision::intersect(const ConvexShape& a, const ConvexShape& b, Vector2& normal, float& penetration)
+{
+	Vector2 simplex[3];
+	unsigned simplexCount;
+
+	if (!gjk(a, b, simplex, simplexCount))
+		return false;
+
+	epa(a, b, simplex, simplexCount, normal, penetration);
+	return true;
+}
@@ -0,0 +1,135 @@
+#include <math.h>
+#include <pplatform.h>
+#include <ptrace.h>
+
+Platform::Platform()
+	:
+	id(0),
+	restitution(0.8f)
+{
+}
+
+unsigned Platform::addContact(ParticleContact *firstContact, unsigned limit)
+{
+	PTRACE_ZONE("Platform::addContact");
+
+	unsigned found = 0;
+
+	// Once there is no room for any more contacts, they are still
+	// found, in a spare one, and kept for the world to collect once
+	// it has made room
+	ParticleContact spare;
+	dropped.clear();
+
+	for (unsigned i = 0; i < particle.size(); i++)
+	{
+		unsigned foundBefore = found;
+		ParticleContact* contact = found < limit ? firstContact + found : &spare;
+
+		// Sleeping particles stay where they are
+		if (!particle[i]->isAwake())
+			continue;
+
+		// Check for penetration
+		Vector2 toParticle = particle[i]->getPosition() - start;
+		Vector2 lineDirection = end - start;
+
+		float projected = toParticle * lineDirection;
+		float platformSqLength = lineDirection.squareMagnitude();
+		float squareRadius = particle[i]->getRadius()*particle[i]->getRadius();;
+
+		//Calculate whether non-sphere objects have made contact with platform
+		if (!particle[i]->isSphere())
+		{
+			Vector2 pos = particle[i]->getPosition();
+
+			//check if particle has an x-coordinate that allows it to touch the platform
+			if (pos.x + particle[i]->getWidth() / 2.0f > start.x && pos.x - particle[i]->getWidth() / 2.0f < end.x)
+			{
+				float slope = (end.y - start.y) / (end.x - start.x);
+				float yIntercept = end.y - slope * end.x;
+				float platformYVal = slope * pos.x + yIntercept;
+
+				//check if the particle is touching the line
+				if (pos.y - particle[i]->getHeight() / 2.0f <= platformYVal && pos.y + particle[i]->getHeight() / 2.0f >= platformYVal)
+				{
+					// We have a collision
+					Vector2 closestPoint = start + lineDirection*(projected / platformSqLength);
+
+					contact->contactNormal = (particle[i]->getPosition() - closestPoint).unit();
+					contact->restitution = restitution;
+					contact->particle[0] = particle[i];
+					contact->particle[1] = 0;
+					contact->pairId = ParticleContact::makeSceneryPairId(i, id);
+					contact->penetration = particle[i]->getHeight() * 0.5f - (pos.y - platformYVal);//particle[i]->getRadius() - sqrt(distanceToPlatform);
+					found++;
+				}
+			}
+		}
+		else if (projected <= 0)
+		{
+			// The blob is nearest to the start point
+			if (toParticle.squareMagnitude() < squareRadius)
+			{
+				// We have a collision
+				contact->contactNormal = toParticle.unit();
+				contact->restitution = restitution;
+				contact->particle[0] = particle[i];
+				contact->particle[1] = 0;
+				contact->pairId = ParticleContact::makeSceneryPairId(i, id);
+				contact->penetration = particle[i]->getRadius() - toParticle.magnitude();
+				found++;
+			}
+
+		}
+		else if (projected >= platformSqLength)
+		{
+			// The blob is nearest to the end point
+			toParticle = particle[0]->getPosition() - end;
+			if (toParticle.squareMagnitude() < squareRadius)
+			{
+				// We have a collision
+				contact->contactNormal = toParticle.unit();
+				contact->restitution = restitution;
+				contact->particle[0] = particle[i];
+				contact->particle[1] = 0;
+				contact->pairId = ParticleContact::makeSceneryPairId(i, id);
+				contact->penetration = particle[i]->getRadius() - toParticle.magnitude();
+				found++;
+			}
+		}
+		else
+		{
+			// the blob is nearest to the middle.
+			float distanceToPlatform = toParticle.squareMagnitude() - projected*projected / platformSqLength;
+			if (distanceToPlatform < squareRadius)
+			{
+				// We have a collision
+				Vector2 closestPoint = start + lineDirection*(projected / platformSqLength);
+
+				contact->contactNormal = (particle[i]->getPosition() - closestPoint).unit();
+				contact->restitution = restitution;
+				contact->particle[0] = particle[i];
+				contact->particle[1] = 0;
+				contact->pairId = ParticleContact::makeSceneryPairId(i, id);
+				contact->penetration = particle[i]->getRadius() - sqrt(distanceToPlatform);
+				found++;
+			}
+		}
+
+		if (found > foundBefore && contact == &spare)
+			dropped.add(spare);
+	}
+
+	return found < limit ? found : limit;
+}
+
+unsigned Platform::getContactsDropped() const
+{
+	return dropped.getCount();
+}
+
+unsigned Platform::addDroppedContacts(ParticleContact *contact, unsigned limit)
+{
+	return dropped.take(contact, limit);
+}
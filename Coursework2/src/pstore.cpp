@@ -0,0 +1,330 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pstore.h>
+
+//Pick the widest vector instructions the compiler has been allowed to use
+#if defined(__AVX__)
+#define PSTORE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PSTORE_SSE
+#include <emmintrin.h>
+#endif
+
+//Allocates an array of floats aligned to a multiple of the vector width. The pointer
+//returned by malloc is kept just before the array so that it can be freed.
+static float* allocateArray(unsigned count)
+{
+	const size_t alignment = ParticleStore::WIDTH * sizeof(float);
+
+	char* block = (char*)malloc(count * sizeof(float) + alignment + sizeof(void*));
+	char* aligned = (char*)(((size_t)(block + sizeof(void*)) + alignment - 1) & ~(alignment - 1));
+	((void**)aligned)[-1] = block;
+
+	return (float*)aligned;
+}
+
+static void freeArray(float* array)
+{
+	if (array)
+		free(((void**)array)[-1]);
+}
+
+ParticleStore::ParticleStore(unsigned capacity)
+	:
+	positionX(0), positionY(0), velocityX(0), velocityY(0), forceX(0), forceY(0),
+	accelerationX(0), accelerationY(0), inverseMass(0), radius(0), awake(0), sleepTime(0),
+	capacity(0),
+	size(0),
+	live(0)
+{
+	grow(capacity > 0 ? capacity : WIDTH);
+}
+
+ParticleStore::~ParticleStore()
+{
+	float** arrays[] = { &positionX, &positionY, &velocityX, &velocityY, &forceX, &forceY,
+		&accelerationX, &accelerationY, &inverseMass, &radius, &awake, &sleepTime };
+
+	for (unsigned a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++)
+		freeArray(*arrays[a]);
+}
+
+void ParticleStore::grow(unsigned newCapacity)
+{
+	//Keep the arrays a whole number of vectors long
+	newCapacity = (newCapacity + WIDTH - 1) / WIDTH * WIDTH;
+
+	float** arrays[] = { &positionX, &positionY, &velocityX, &velocityY, &forceX, &forceY,
+		&accelerationX, &accelerationY, &inverseMass, &radius, &awake, &sleepTime };
+
+	for (unsigned a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++)
+	{
+		float* array = allocateArray(newCapacity);
+
+		//New slots start out zeroed, so they take no part in any pass over the store
+		memset(array, 0, newCapacity * sizeof(float));
+		if (*arrays[a])
+			memcpy(array, *arrays[a], capacity * sizeof(float));
+
+		freeArray(*arrays[a]);
+		*arrays[a] = array;
+	}
+
+	capacity = newCapacity;
+}
+
+void ParticleStore::clearSlot(unsigned slot)
+{
+	positionX[slot] = positionY[slot] = 0;
+	velocityX[slot] = velocityY[slot] = 0;
+	forceX[slot] = forceY[slot] = 0;
+	accelerationX[slot] = accelerationY[slot] = 0;
+	inverseMass[slot] = 0;
+	radius[slot] = 0;
+	awake[slot] = 0;
+	sleepTime[slot] = 0;
+}
+
+unsigned ParticleStore::allocate()
+{
+	unsigned slot;
+
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		if (size == capacity)
+			grow(capacity * 2);
+
+		slot = size++;
+	}
+
+	clearSlot(slot);
+	awake[slot] = 1;
+	live++;
+	return slot;
+}
+
+void ParticleStore::release(unsigned slot)
+{
+	clearSlot(slot);
+	freeSlots.push_back(slot);
+	live--;
+}
+
+unsigned ParticleStore::getSize() const
+{
+	return (size + WIDTH - 1) / WIDTH * WIDTH;
+}
+
+unsigned ParticleStore::getLiveCount() const
+{
+	return live;
+}
+
+ParticleStore& ParticleStore::getDefault()
+{
+	static ParticleStore store;
+	return store;
+}
+
+void ParticleStore::integrate(float duration, unsigned begin, unsigned end)
+{
+	unsigned i = begin;
+
+	// Work out the acceleration from the force, update the position from the velocity
+	// and the velocity from the acceleration, and clear the forces, several particles
+	// at a time. Particles with zero inverse mass are masked out rather than skipped.
+#if defined(PSTORE_AVX)
+	__m256 dt = _mm256_set1_ps(duration);
+	__m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 inverse = _mm256_loadu_ps(inverseMass + i);
+		__m256 moving = _mm256_and_ps(_mm256_cmp_ps(inverse, zero, _CMP_GT_OQ),
+			_mm256_cmp_ps(_mm256_loadu_ps(awake + i), zero, _CMP_GT_OQ));
+
+		__m256 px = _mm256_loadu_ps(positionX + i);
+		__m256 py = _mm256_loadu_ps(positionY + i);
+		__m256 vx = _mm256_loadu_ps(velocityX + i);
+		__m256 vy = _mm256_loadu_ps(velocityY + i);
+		__m256 fx = _mm256_loadu_ps(forceX + i);
+		__m256 fy = _mm256_loadu_ps(forceY + i);
+
+		__m256 newPx = _mm256_add_ps(px, _mm256_mul_ps(vx, dt));
+		__m256 newPy = _mm256_add_ps(py, _mm256_mul_ps(vy, dt));
+
+		__m256 accX = _mm256_add_ps(_mm256_loadu_ps(accelerationX + i), _mm256_mul_ps(fx, inverse));
+		__m256 accY = _mm256_add_ps(_mm256_loadu_ps(accelerationY + i), _mm256_mul_ps(fy, inverse));
+
+		__m256 newVx = _mm256_add_ps(vx, _mm256_mul_ps(accX, dt));
+		__m256 newVy = _mm256_add_ps(vy, _mm256_mul_ps(accY, dt));
+
+		_mm256_storeu_ps(positionX + i, _mm256_blendv_ps(px, newPx, moving));
+		_mm256_storeu_ps(positionY + i, _mm256_blendv_ps(py, newPy, moving));
+		_mm256_storeu_ps(velocityX + i, _mm256_blendv_ps(vx, newVx, moving));
+		_mm256_storeu_ps(velocityY + i, _mm256_blendv_ps(vy, newVy, moving));
+		_mm256_storeu_ps(forceX + i, _mm256_andnot_ps(moving, fx));
+		_mm256_storeu_ps(forceY + i, _mm256_andnot_ps(moving, fy));
+	}
+#elif defined(PSTORE_SSE)
+	__m128 dt = _mm_set1_ps(duration);
+	__m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 inverse = _mm_loadu_ps(inverseMass + i);
+		__m128 moving = _mm_and_ps(_mm_cmpgt_ps(inverse, zero), _mm_cmpgt_ps(_mm_loadu_ps(awake + i), zero));
+
+		__m128 px = _mm_loadu_ps(positionX + i);
+		__m128 py = _mm_loadu_ps(positionY + i);
+		__m128 vx = _mm_loadu_ps(velocityX + i);
+		__m128 vy = _mm_loadu_ps(velocityY + i);
+		__m128 fx = _mm_loadu_ps(forceX + i);
+		__m128 fy = _mm_loadu_ps(forceY + i);
+
+		__m128 newPx = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+		__m128 newPy = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+
+		__m128 accX = _mm_add_ps(_mm_loadu_ps(accelerationX + i), _mm_mul_ps(fx, inverse));
+		__m128 accY = _mm_add_ps(_mm_loadu_ps(accelerationY + i), _mm_mul_ps(fy, inverse));
+
+		__m128 newVx = _mm_add_ps(vx, _mm_mul_ps(accX, dt));
+		__m128 newVy = _mm_add_ps(vy, _mm_mul_ps(accY, dt));
+
+		//SSE2 has no blend, so select with and/andnot/or
+		_mm_storeu_ps(positionX + i, _mm_or_ps(_mm_and_ps(moving, newPx), _mm_andnot_ps(moving, px)));
+		_mm_storeu_ps(positionY + i, _mm_or_ps(_mm_and_ps(moving, newPy), _mm_andnot_ps(moving, py)));
+		_mm_storeu_ps(velocityX + i, _mm_or_ps(_mm_and_ps(moving, newVx), _mm_andnot_ps(moving, vx)));
+		_mm_storeu_ps(velocityY + i, _mm_or_ps(_mm_and_ps(moving, newVy), _mm_andnot_ps(moving, vy)));
+		_mm_storeu_ps(forceX + i, _mm_andnot_ps(moving, fx));
+		_mm_storeu_ps(forceY + i, _mm_andnot_ps(moving, fy));
+	}
+#endif
+
+	//Whatever is left over is done one particle at a time
+	for (; i < end; i++)
+	{
+		// We don't integrate things with zero mass, or things that are asleep.
+		if (inverseMass[i] <= 0.0f || awake[i] <= 0.0f)
+			continue;
+
+		positionX[i] += velocityX[i] * duration;
+		positionY[i] += velocityY[i] * duration;
+
+		float accX = accelerationX[i] + forceX[i] * inverseMass[i];
+		float accY = accelerationY[i] + forceY[i] * inverseMass[i];
+
+		velocityX[i] += accX * duration;
+		velocityY[i] += accY * duration;
+
+		forceX[i] = forceY[i] = 0;
+	}
+}
+
+void ParticleStore::applyForces(const ParticleForceTerms& terms, unsigned begin, unsigned end)
+{
+	unsigned i = begin;
+
+	//Gravity is an acceleration, so the force is the gravity times the mass. Drag acts directly
+	//against the velocity, so it is the velocity scaled by -(drag0 + drag1 * s + drag2 * s^2) / s.
+	//Both are masked out rather than skipped where they do not apply.
+#if defined(PSTORE_AVX)
+	__m256 zero = _mm256_setzero_ps();
+	__m256 gravityX = _mm256_set1_ps(terms.gravityX);
+	__m256 gravityY = _mm256_set1_ps(terms.gravityY);
+	__m256 drag0 = _mm256_set1_ps(terms.drag0);
+	__m256 drag1 = _mm256_set1_ps(terms.drag1);
+	__m256 drag2 = _mm256_set1_ps(terms.drag2);
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 inverse = _mm256_loadu_ps(inverseMass + i);
+		__m256 vx = _mm256_loadu_ps(velocityX + i);
+		__m256 vy = _mm256_loadu_ps(velocityY + i);
+		__m256 fx = _mm256_loadu_ps(forceX + i);
+		__m256 fy = _mm256_loadu_ps(forceY + i);
+
+		__m256 moving = _mm256_and_ps(_mm256_cmp_ps(inverse, zero, _CMP_GT_OQ),
+			_mm256_cmp_ps(_mm256_loadu_ps(awake + i), zero, _CMP_GT_OQ));
+
+		//Dividing by the inverse mass gives infinity for static particles, but they are masked out
+		__m256 addX = _mm256_div_ps(gravityX, inverse);
+		__m256 addY = _mm256_div_ps(gravityY, inverse);
+
+		__m256 speedSquared = _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy));
+		__m256 speed = _mm256_sqrt_ps(speedSquared);
+		__m256 dragMagnitude = _mm256_add_ps(drag0,
+			_mm256_add_ps(_mm256_mul_ps(drag1, speed), _mm256_mul_ps(drag2, speedSquared)));
+		__m256 scale = _mm256_and_ps(_mm256_div_ps(dragMagnitude, speed),
+			_mm256_cmp_ps(speedSquared, zero, _CMP_GT_OQ));
+
+		addX = _mm256_sub_ps(addX, _mm256_mul_ps(vx, scale));
+		addY = _mm256_sub_ps(addY, _mm256_mul_ps(vy, scale));
+
+		_mm256_storeu_ps(forceX + i, _mm256_add_ps(fx, _mm256_and_ps(addX, moving)));
+		_mm256_storeu_ps(forceY + i, _mm256_add_ps(fy, _mm256_and_ps(addY, moving)));
+	}
+#elif defined(PSTORE_SSE)
+	__m128 zero = _mm_setzero_ps();
+	__m128 gravityX = _mm_set1_ps(terms.gravityX);
+	__m128 gravityY = _mm_set1_ps(terms.gravityY);
+	__m128 drag0 = _mm_set1_ps(terms.drag0);
+	__m128 drag1 = _mm_set1_ps(terms.drag1);
+	__m128 drag2 = _mm_set1_ps(terms.drag2);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 inverse = _mm_loadu_ps(inverseMass + i);
+		__m128 vx = _mm_loadu_ps(velocityX + i);
+		__m128 vy = _mm_loadu_ps(velocityY + i);
+		__m128 fx = _mm_loadu_ps(forceX + i);
+		__m128 fy = _mm_loadu_ps(forceY + i);
+
+		__m128 moving = _mm_and_ps(_mm_cmpgt_ps(inverse, zero), _mm_cmpgt_ps(_mm_loadu_ps(awake + i), zero));
+
+		__m128 addX = _mm_div_ps(gravityX, inverse);
+		__m128 addY = _mm_div_ps(gravityY, inverse);
+
+		__m128 speedSquared = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy));
+		__m128 speed = _mm_sqrt_ps(speedSquared);
+		__m128 dragMagnitude = _mm_add_ps(drag0,
+			_mm_add_ps(_mm_mul_ps(drag1, speed), _mm_mul_ps(drag2, speedSquared)));
+		__m128 scale = _mm_and_ps(_mm_div_ps(dragMagnitude, speed), _mm_cmpgt_ps(speedSquared, zero));
+
+		addX = _mm_sub_ps(addX, _mm_mul_ps(vx, scale));
+		addY = _mm_sub_ps(addY, _mm_mul_ps(vy, scale));
+
+		_mm_storeu_ps(forceX + i, _mm_add_ps(fx, _mm_and_ps(addX, moving)));
+		_mm_storeu_ps(forceY + i, _mm_add_ps(fy, _mm_and_ps(addY, moving)));
+	}
+#endif
+
+	for (; i < end; i++)
+	{
+		if (inverseMass[i] <= 0.0f || awake[i] <= 0.0f)
+			continue;
+
+		float addX = terms.gravityX / inverseMass[i];
+		float addY = terms.gravityY / inverseMass[i];
+
+		float speedSquared = velocityX[i] * velocityX[i] + velocityY[i] * velocityY[i];
+
+		if (speedSquared > 0)
+		{
+			float speed = sqrtf(speedSquared);
+			float scale = (terms.drag0 + terms.drag1 * speed + terms.drag2 * speedSquared) / speed;
+			addX -= velocityX[i] * scale;
+			addY -= velocityY[i] * scale;
+		}
+
+		forceX[i] += addX;
+		forceY[i] += addY;
+	}
+}
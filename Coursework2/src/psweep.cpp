@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <psweep.h>
+
+//Orders endpoints by value. Where two are equal the minimum comes first, so
+//that boxes which just touch are treated as overlapping.
+static bool endpointLess(float valueA, bool maxA, float valueB, bool maxB)
+{
+	return valueA < valueB || (valueA == valueB && !maxA && maxB);
+}
+
+static unsigned long long pairKey(unsigned a, unsigned b)
+{
+	if (a > b)
+	{
+		unsigned temp = a;
+		a = b;
+		b = temp;
+	}
+
+	return ((unsigned long long)a << 32) | b;
+}
+
+ParticleSweepAndPrune::ParticleSweepAndPrune(bool bothAxes)
+	:
+	bothAxes(bothAxes),
+	trackedParticles(0),
+	trackedCount(0)
+{
+}
+
+bool ParticleSweepAndPrune::overlaps(unsigned a, unsigned b, unsigned axis) const
+{
+	return mins[a][axis] <= maxs[b][axis] && mins[b][axis] <= maxs[a][axis];
+}
+
+void ParticleSweepAndPrune::addPair(unsigned a, unsigned b)
+{
+	unsigned long long key = pairKey(a, b);
+
+	if (trackedIndex.find(key) != trackedIndex.end())
+		return;
+
+	TrackedPair entry;
+	entry.pair.first = a < b ? a : b;
+	entry.pair.second = a < b ? b : a;
+
+	//When both axes are swept every tracked pair is touching. Otherwise
+	//touching is worked out on y once the sort is finished.
+	entry.touching = bothAxes;
+	if (bothAxes)
+		addedPairs.push_back(entry.pair);
+
+	trackedIndex[key] = tracked.size();
+	tracked.push_back(entry);
+}
+
+void ParticleSweepAndPrune::removePair(unsigned a, unsigned b)
+{
+	std::unordered_map<unsigned long long, unsigned>::iterator found = trackedIndex.find(pairKey(a, b));
+
+	if (found == trackedIndex.end())
+		return;
+
+	unsigned index = found->second;
+	trackedIndex.erase(found);
+
+	if (tracked[index].touching)
+		removedPairs.push_back(tracked[index].pair);
+
+	//Fill the gap with the last pair in the list
+	unsigned last = tracked.size() - 1;
+	if (index != last)
+	{
+		tracked[index] = tracked[last];
+		trackedIndex[pairKey(tracked[index].pair.first, tracked[index].pair.second)] = index;
+	}
+	tracked.pop_back();
+}
+
+void ParticleSweepAndPrune::rebuild(Particle* particles, unsigned count)
+{
+	//Everything that was touching stops, since the indices no longer mean the same thing
+	for (unsigned i = 0; i < tracked.size(); i++)
+		if (tracked[i].touching)
+			removedPairs.push_back(tracked[i].pair);
+
+	tracked.clear();
+	trackedIndex.clear();
+
+	trackedParticles = particles;
+	trackedCount = count;
+
+	unsigned axes = bothAxes ? 2 : 1;
+
+	for (unsigned axis = 0; axis < axes; axis++)
+	{
+		endpoints[axis].resize(count * 2);
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			Endpoint& min = endpoints[axis][i * 2];
+			Endpoint& max = endpoints[axis][i * 2 + 1];
+
+			min.value = mins[i][axis];
+			min.data = i << 1;
+			max.value = maxs[i][axis];
+			max.data = (i << 1) | 1;
+		}
+
+		std::sort(endpoints[axis].begin(), endpoints[axis].end(),
+			[](const Endpoint& a, const Endpoint& b) { return endpointLess(a.value, a.isMax(), b.value, b.isMax()); });
+	}
+
+	//Sweep along x, pairing each box that opens with all of the boxes that are already open
+	open.clear();
+
+	for (unsigned e = 0; e < endpoints[0].size(); e++)
+	{
+		unsigned particle = endpoints[0][e].particle();
+
+		if (endpoints[0][e].isMax())
+		{
+			open.erase(std::find(open.begin(), open.end(), particle));
+			continue;
+		}
+
+		for (unsigned i = 0; i < open.size(); i++)
+			if (!bothAxes || overlaps(particle, open[i], 1))
+				addPair(particle, open[i]);
+
+		open.push_back(particle);
+	}
+}
+
+void ParticleSweepAndPrune::sortAxis(unsigned axis)
+{
+	std::vector<Endpoint>& list = endpoints[axis];
+
+	for (unsigned i = 1; i < list.size(); i++)
+	{
+		Endpoint key = list[i];
+		unsigned j = i;
+
+		while (j > 0 && endpointLess(key.value, key.isMax(), list[j - 1].value, list[j - 1].isMax()))
+		{
+			const Endpoint& passed = list[j - 1];
+
+			//A minimum passing a maximum means the two boxes may have started overlapping,
+			//and a maximum passing a minimum means they have stopped. Insertion sort swaps
+			//each out of order pair exactly once, so the final bounds decide the first case.
+			if (!key.isMax() && passed.isMax())
+			{
+				unsigned a = key.particle();
+				unsigned b = passed.particle();
+
+				if (overlaps(a, b, axis) && (!bothAxes || overlaps(a, b, 1 - axis)))
+					addPair(a, b);
+			}
+			else if (key.isMax() && !passed.isMax())
+			{
+				removePair(key.particle(), passed.particle());
+			}
+
+			list[j] = passed;
+			j--;
+		}
+
+		list[j] = key;
+	}
+}
+
+void ParticleSweepAndPrune::update(Particle* particles, unsigned count)
+{
+	addedPairs.clear();
+	removedPairs.clear();
+
+	mins.resize(count);
+	maxs.resize(count);
+
+	for (unsigned i = 0; i < count; i++)
+		calcBounds(particles[i], mins[i], maxs[i]);
+
+	if (particles != trackedParticles || count != trackedCount)
+	{
+		rebuild(particles, count);
+	}
+	else
+	{
+		unsigned axes = bothAxes ? 2 : 1;
+
+		for (unsigned axis = 0; axis < axes; axis++)
+		{
+			//Move each endpoint to where its particle is now, then put the list back in order
+			for (unsigned e = 0; e < endpoints[axis].size(); e++)
+			{
+				Endpoint& endpoint = endpoints[axis][e];
+				unsigned particle = endpoint.particle();
+
+				endpoint.value = endpoint.isMax() ? maxs[particle][axis] : mins[particle][axis];
+			}
+
+			sortAxis(axis);
+		}
+	}
+
+	//With only x swept, check the overlapping pairs on y and report any that changed
+	if (!bothAxes)
+	{
+		for (unsigned i = 0; i < tracked.size(); i++)
+		{
+			bool touching = overlaps(tracked[i].pair.first, tracked[i].pair.second, 1);
+
+			if (touching && !tracked[i].touching)
+				addedPairs.push_back(tracked[i].pair);
+			else if (!touching && tracked[i].touching)
+				removedPairs.push_back(tracked[i].pair);
+
+			tracked[i].touching = touching;
+		}
+	}
+
+	pairs.clear();
+
+	for (unsigned i = 0; i < tracked.size(); i++)
+		if (tracked[i].touching)
+			pairs.push_back(tracked[i].pair);
+}
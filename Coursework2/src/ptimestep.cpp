@@ -0,0 +1,102 @@
+#include <math.h>
+#include <ptimestep.h>
+
+FixedTimestep::FixedTimestep(float stepDuration, unsigned substeps, unsigned maxSteps)
+	:
+	stepDuration(stepDuration),
+	substeps(substeps ? substeps : 1),
+	maxSteps(maxSteps ? maxSteps : 1),
+	accumulator(0),
+	droppedTime(0),
+	stepsRun(0)
+{
+}
+
+void FixedTimestep::setStepDuration(float stepDuration)
+{
+	FixedTimestep::stepDuration = stepDuration;
+}
+
+float FixedTimestep::getStepDuration() const
+{
+	return (float)stepDuration;
+}
+
+void FixedTimestep::setSubsteps(unsigned substeps)
+{
+	FixedTimestep::substeps = substeps ? substeps : 1;
+}
+
+unsigned FixedTimestep::getSubsteps() const
+{
+	return substeps;
+}
+
+float FixedTimestep::getSubstepDuration() const
+{
+	return (float)(stepDuration / substeps);
+}
+
+void FixedTimestep::setMaxSteps(unsigned maxSteps)
+{
+	FixedTimestep::maxSteps = maxSteps ? maxSteps : 1;
+}
+
+unsigned FixedTimestep::getMaxSteps() const
+{
+	return maxSteps;
+}
+
+unsigned FixedTimestep::advance(double elapsed)
+{
+	if (elapsed > 0)
+		accumulator += elapsed;
+
+	if (stepDuration <= 0)
+		return 0;
+
+	unsigned steps = 0;
+	while (accumulator >= stepDuration && steps < maxSteps)
+	{
+		accumulator -= stepDuration;
+		steps++;
+	}
+
+	//Anything beyond the budget is dropped, keeping only the part of a step
+	//that was left over, so the next frame does not start behind
+	if (accumulator >= stepDuration)
+	{
+		double whole = stepDuration * floor(accumulator / stepDuration);
+		droppedTime += whole;
+		accumulator -= whole;
+	}
+
+	stepsRun += steps;
+	return steps;
+}
+
+float FixedTimestep::getAlpha() const
+{
+	if (stepDuration <= 0)
+		return 1.0f;
+
+	float alpha = (float)(accumulator / stepDuration);
+	return alpha < 1.0f ? alpha : 1.0f;
+}
+
+double FixedTimestep::getDroppedTime() const
+{
+	return droppedTime;
+}
+
+unsigned long long FixedTimestep::getStepsRun() const
+{
+	return stepsRun;
+}
+
+void FixedTimestep::reset()
+{
+	accumulator = 0;
+	droppedTime = 0;
+	stepsRun = 0;
+}
@@ -0,0 +1,317 @@
+#include <ptrace.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled(false);
+
+//One slot of a thread's buffer. Only that thread writes to it, but another may be reading it at
+//the same time, so every field is atomic. sequence is zero while the slot is being written, and
+//then one more than the index of the zone it holds, so a reader can tell whether what it read
+//was one whole zone.
+struct TraceEvent
+{
+	std::atomic<unsigned long long> sequence;
+	std::atomic<const char*> name;
+	std::atomic<unsigned long long> begin;
+	std::atomic<unsigned long long> end;
+};
+
+//A zone copied out of a buffer
+struct TraceZoneCopy
+{
+	const char* name;
+	unsigned long long begin;
+	unsigned long long end;
+};
+
+//The zones recorded by one thread. Only that thread writes to it: it fills in the slot after the
+//last zone written, then counts it.
+struct TraceBuffer
+{
+	std::vector<TraceEvent> events;
+	std::atomic<unsigned long long> written;
+
+	//Zones before this one have been cleared
+	std::atomic<unsigned long long> first;
+
+	unsigned thread;
+	char name[64];
+
+	TraceBuffer(unsigned size, unsigned thread) : events(size), written(0), first(0), thread(thread)
+	{
+		snprintf(name, sizeof(name), "thread %u", thread);
+	}
+};
+
+//Every thread's buffer. The lock is only taken to add a buffer or to read them all.
+static std::mutex buffersMutex;
+static std::vector<TraceBuffer*> buffers;
+static unsigned bufferSize = 1 << 16;
+
+static thread_local TraceBuffer* threadBuffer = 0;
+static thread_local char threadName[64] = "";
+
+static unsigned long long slowFrameThreshold = 0;
+static std::string slowFramePrefix;
+static unsigned slowFrameMaxDumps = 0;
+static unsigned slowFrameDumps = 0;
+static unsigned long long frameNumber = 0;
+
+//A slow frame waiting to be written: how far each buffer had got when it ended
+struct PendingDump
+{
+	unsigned long long frame;
+	std::vector<unsigned long long> written;
+};
+
+static std::mutex pendingMutex;
+static std::vector<PendingDump> pendingDumps;
+
+static bool writeTrace(const char* path, const std::vector<unsigned long long>* upTo);
+
+static TraceBuffer* getThreadBuffer()
+{
+	if (!threadBuffer)
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		threadBuffer = new TraceBuffer(bufferSize, (unsigned)buffers.size());
+		if (threadName[0])
+			snprintf(threadBuffer->name, sizeof(threadBuffer->name), "%s", threadName);
+		buffers.push_back(threadBuffer);
+	}
+
+	return threadBuffer;
+}
+
+bool Tracer::isAvailable()
+{
+#ifdef PTRACE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+	Tracer::enabled.store(enabled && isAvailable(), std::memory_order_relaxed);
+}
+
+void Tracer::setBufferSize(unsigned zones)
+{
+	unsigned size = 1;
+	while (size < zones && size < (1u << 31))
+		size <<= 1;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	bufferSize = size;
+}
+
+void Tracer::setThreadName(const char* name)
+{
+	//The name is kept until the thread has a buffer, which is only made once it records a zone
+	snprintf(threadName, sizeof(threadName), "%s", name);
+
+	if (threadBuffer)
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		snprintf(threadBuffer->name, sizeof(threadBuffer->name), "%s", name);
+	}
+}
+
+void Tracer::setSlowFrameDump(unsigned long long thresholdNs, const char* pathPrefix, unsigned maxDumps)
+{
+	slowFrameThreshold = thresholdNs;
+	slowFramePrefix = pathPrefix ? pathPrefix : "trace";
+	slowFrameMaxDumps = maxDumps;
+	slowFrameDumps = 0;
+
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pendingDumps.clear();
+}
+
+unsigned Tracer::getSlowFrameDumps()
+{
+	return slowFrameDumps;
+}
+
+void Tracer::record(const char* name, unsigned long long begin, unsigned long long end)
+{
+	TraceBuffer* buffer = getThreadBuffer();
+
+	unsigned long long index = buffer->written.load(std::memory_order_relaxed);
+	TraceEvent& event = buffer->events[index & (buffer->events.size() - 1)];
+
+	//Mark the slot as being written. The fields are released, so a reader that sees any of them
+	//changed will also see the mark.
+	event.sequence.store(0, std::memory_order_relaxed);
+	event.name.store(name, std::memory_order_release);
+	event.begin.store(begin, std::memory_order_release);
+	event.end.store(end, std::memory_order_release);
+	event.sequence.store(index + 1, std::memory_order_release);
+
+	buffer->written.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::endFrame(unsigned long long durationNs)
+{
+	frameNumber++;
+
+	if (slowFrameThreshold == 0 || durationNs <= slowFrameThreshold)
+		return;
+
+	//Only note how far each buffer has got: the file is written later, by writePendingDumps,
+	//so that writing it does not hold up the frame
+	std::lock_guard<std::mutex> pendingLock(pendingMutex);
+
+	if (slowFrameDumps + pendingDumps.size() >= slowFrameMaxDumps)
+		return;
+
+	pendingDumps.push_back(PendingDump());
+	PendingDump& dump = pendingDumps.back();
+	dump.frame = frameNumber;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	dump.written.resize(buffers.size());
+	for (unsigned i = 0; i < buffers.size(); i++)
+		dump.written[i] = buffers[i]->written.load(std::memory_order_acquire);
+}
+
+unsigned Tracer::writePendingDumps()
+{
+	std::vector<PendingDump> dumps;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		dumps.swap(pendingDumps);
+	}
+
+	unsigned written = 0;
+	for (unsigned i = 0; i < dumps.size(); i++)
+	{
+		char path[32];
+		snprintf(path, sizeof(path), "-%llu.json", dumps[i].frame);
+
+		if (writeTrace((slowFramePrefix + path).c_str(), &dumps[i].written))
+			written++;
+	}
+
+	slowFrameDumps += written;
+	return written;
+}
+
+void Tracer::clear()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	for (unsigned i = 0; i < buffers.size(); i++)
+		buffers[i]->first.store(buffers[i]->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+//Writes a string for JSON, escaping what has to be
+static void writeString(FILE* file, const char* text)
+{
+	fputc('"', file);
+
+	for (; *text; text++)
+	{
+		if (*text == '"' || *text == '\\')
+			fprintf(file, "\\%c", *text);
+		else if ((unsigned char)*text < 0x20)
+			fprintf(file, "\\u%04x", (unsigned)*text);
+		else
+			fputc(*text, file);
+	}
+
+	fputc('"', file);
+}
+
+//Copies out the zone with the given index from the slot it was written to, returning false if it
+//has been, or is being, written over
+static bool copyZone(const TraceEvent& event, unsigned long long index, TraceZoneCopy& zone)
+{
+	if (event.sequence.load(std::memory_order_acquire) != index + 1)
+		return false;
+
+	zone.name = event.name.load(std::memory_order_acquire);
+	zone.begin = event.begin.load(std::memory_order_acquire);
+	zone.end = event.end.load(std::memory_order_acquire);
+
+	//If the thread started writing over the slot while it was being copied, it will have marked it
+	return event.sequence.load(std::memory_order_relaxed) == index + 1;
+}
+
+//Writes the zones each buffer holds, up to the given index for each buffer (or all of them)
+static bool writeTrace(const char* path, const std::vector<unsigned long long>* upTo)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	//Copy out each buffer's zones, up to how far it had got when asked (or has got now). Any the
+	//thread has written over since are left out.
+	std::vector<std::vector<TraceZoneCopy> > zones(buffers.size());
+	unsigned long long origin = ~0ull;
+
+	for (unsigned i = 0; i < buffers.size(); i++)
+	{
+		TraceBuffer& buffer = *buffers[i];
+		unsigned long long size = buffer.events.size();
+
+		unsigned long long written = buffer.written.load(std::memory_order_acquire);
+		if (upTo)
+			written = i < upTo->size() ? (*upTo)[i] : 0;
+
+		unsigned long long first = buffer.first.load(std::memory_order_relaxed);
+		if (written > size && first < written - size)
+			first = written - size;
+
+		std::vector<TraceZoneCopy>& copy = zones[i];
+		for (unsigned long long index = first; index < written; index++)
+		{
+			TraceZoneCopy zone;
+			if (!copyZone(buffer.events[index & (size - 1)], index, zone))
+				continue;
+
+			copy.push_back(zone);
+			if (zone.begin < origin)
+				origin = zone.begin;
+		}
+	}
+
+	//Times are in microseconds from the first zone written out
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	bool firstEvent = true;
+	for (unsigned i = 0; i < buffers.size(); i++)
+	{
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+			firstEvent ? "" : ",\n", buffers[i]->thread);
+		writeString(file, buffers[i]->name);
+		fprintf(file, "}}");
+		firstEvent = false;
+
+		for (unsigned j = 0; j < zones[i].size(); j++)
+		{
+			const TraceZoneCopy& zone = zones[i][j];
+
+			fprintf(file, ",\n{\"name\":");
+			writeString(file, zone.name);
+			fprintf(file, ",\"cat\":\"physics\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				buffers[i]->thread, (zone.begin - origin) / 1000.0, (zone.end - zone.begin) / 1000.0);
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
+
+bool Tracer::writeChromeTrace(const char* path)
+{
+	return writeTrace(path, 0);
+}
@@ -0,0 +1,118 @@
+#include <pwalls.h>
+
+ParticleWalls::ParticleWalls(float halfWidth, float halfHeight)
+	:
+	halfWidth(halfWidth),
+	halfHeight(halfHeight)
+{
+}
+
+void ParticleWalls::setBounds(float halfWidth, float halfHeight)
+{
+	ParticleWalls::halfWidth = halfWidth;
+	ParticleWalls::halfHeight = halfHeight;
+}
+
+void ParticleWalls::resolve(Particle* particles, unsigned numParticles) const
+{
+	for (unsigned i = 0; i < numParticles; i++)
+	{
+		boxCollisionResolve(particles + i);
+
+		if (outOfBoxTest(particles + i))
+			outOfBoxResolve(particles + i);
+	}
+}
+
+// detect if the particle colided with the box and produce a response
+void ParticleWalls::boxCollisionResolve(Particle* particle) const
+{
+	Vector2 position = particle->getPosition();
+	Vector2 velocity = particle->getVelocity();
+	float radius = particle->getRadius();
+
+	float w = halfWidth;
+	float h = halfHeight;
+
+	if (particle->isSphere())
+	{
+		// Reverse direction when you reach left or right edge
+		if (position.x > w - radius || position.x < -w + radius)
+			particle->setVelocity(-velocity.x, velocity.y);
+
+		// Reverse direction when you reach top or bottom edge
+		if (position.y > h - radius || position.y < -h + radius)
+			particle->setVelocity(velocity.x, -velocity.y);
+	}
+	else
+	{
+		float particleWidth = particle->getWidth();
+		float particleHeight = particle->getHeight();
+
+		// Reverse direction when you reach left or right edge
+		if (position.x - 0.5f * particleWidth < -w || position.x + 0.5f * particleWidth > w)
+			particle->setVelocity(-velocity.x, velocity.y);
+
+		// Reverse direction when you reach top or bottom edge
+		if (position.y - 0.5f * particleHeight < -h || position.y + 0.5f * particleHeight > h)
+			particle->setVelocity(velocity.x, -velocity.y);
+	}
+}
+
+//  Check bounds. This is in case the window is made
+//  smaller while the sphere is bouncing and the 
+//  sphere suddenly finds itself outside the new
+//  clipping volume
+bool ParticleWalls::outOfBoxTest(Particle* particle) const
+{
+	Vector2 position = particle->getPosition();
+	float radius = particle->getRadius();
+
+	if (particle->isSphere())
+	{
+		if ((position.x > halfWidth - radius) || (position.x < -halfWidth + radius)) return true;
+		if ((position.y > halfHeight - radius) || (position.y < -halfHeight + radius)) return true;
+	}
+	else
+	{
+		if (position.x - 0.5f * particle->getWidth() < -halfWidth || position.x + 0.5f * particle->getWidth() > halfWidth)
+			return true;
+
+		if (position.y - 0.5f * particle->getHeight() < -halfHeight || position.y + 0.5f * particle->getHeight() > halfHeight)
+			return true;
+	}
+	return false;
+}
+
+//  Check bounds. This is in case the window is made
+//  smaller while the sphere is bouncing and the 
+//  sphere suddenly finds itself outside the new
+//  clipping volume
+void ParticleWalls::outOfBoxResolve(Particle* particle) const
+{
+	Vector2 position = particle->getPosition();
+	float radius = particle->getRadius();
+
+	if (particle->isSphere())
+	{
+		if (position.x > halfWidth - radius)        position.x = halfWidth - radius;
+		else if (position.x < -halfWidth + radius)  position.x = -halfWidth + radius;
+
+		if (position.y > halfHeight - radius)        position.y = halfHeight - radius;
+		else if (position.y < -halfHeight + radius)  position.y = -halfHeight + radius;
+	}
+	else
+	{
+		if (position.x - 0.5f * particle->getWidth() < -halfWidth)
+			position.x = -halfWidth + 0.5f * particle->getWidth();
+		else if (position.x + 0.5f * particle->getWidth() > halfWidth)
+			position.x = halfWidth - 0.5f * particle->getWidth();
+
+		if (position.y - 0.5f * particle->getHeight() < -halfHeight)
+			position.y = -halfHeight + 0.5f * particle->getHeight();
+		else if (position.y + 0.5f * particle->getHeight() > halfHeight)
+			position.y = halfHeight - 0.5f * particle->getHeight();
+	}
+
+	particle->setPosition(position.x, position.y);
+}
@@ -1,55 +1,286 @@
 #include <cstdlib>
+#include <math.h>
+#include <algorithm>
 #include <pworld.h>
+#include <ptrace.h>
+
+ParticleWorldStats::ParticleWorldStats()
+	:
+	contacts(0),
+	droppedContacts(0),
+	iterationsUsed(0),
+	maxClosingVelocity(0)
+{
+	for (unsigned stage = 0; stage < STAGE_COUNT; stage++)
+		stageTime[stage] = 0;
+}
 
 ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations)
 	:
 	resolver(iterations),
-	maxContacts(maxContacts)
+	sleeping(false),
+	sleepSpeed(1.0f),
+	timeToSleep(0.5f),
+	jobs(0),
+	deterministic(false),
+	batchStore(0),
+	batchCandidate(0),
+	batchLiveCount(0),
+	batchStoreValid(false),
+	contacts(0),
+	contactCapacity(0),
+	maxContacts(maxContacts),
+	contactHighWater(0),
+	contactLimitReached(false),
+	historyCount(0),
+	historyNext(0)
 {
-	contacts = new ParticleContact[maxContacts];
 	calculateIterations = (iterations == 0);
 
 }
 
 ParticleWorld::~ParticleWorld()
 {
-	delete[] contacts;
+}
+
+//The room for contacts made the first time any are generated
+static const unsigned INITIAL_CONTACTS = 64;
+
+unsigned ParticleWorld::addContacts(ParticleContactGenerator* generator, unsigned next)
+{
+	unsigned used = generator->addContact(contacts + next, contactCapacity - next);
+
+	// If the generator had room to spare, it has reported everything
+	while (next + used == contactCapacity)
+	{
+		unsigned dropped = generator->getContactsDropped();
+		bool counted = dropped != ParticleContactGenerator::UNCOUNTED;
+
+		// Nor if it says it found exactly as many as there was room for
+		if (counted && dropped == 0)
+			return used;
+
+		if (contactCapacity >= maxContacts)
+		{
+			contactLimitReached = true;
+			if (counted)
+				stats.droppedContacts += dropped;
+			return used;
+		}
+
+		// Otherwise make more room (keeping the contacts already there),
+		// with room for everything the generator found if it said how many that was
+		unsigned size = contactCapacity * 2;
+		unsigned needed = next + used + (counted ? dropped : 0);
+		if (size < INITIAL_CONTACTS) size = INITIAL_CONTACTS;
+		if (size < needed) size = needed;
+		if (size > maxContacts) size = maxContacts;
+
+		ParticleContact* grown = arena.allocate<ParticleContact>(size);
+		std::copy(contacts, contacts + next + used, grown);
+
+		contacts = grown;
+		contactCapacity = size;
+
+		// A generator that kept the contacts it had no room for hands them over, so it does not
+		// have to generate them again. Any other is asked again from the start.
+		if (counted)
+			used += generator->addDroppedContacts(contacts + next + used, contactCapacity - next - used);
+		else
+			used = generator->addContact(contacts + next, contactCapacity - next);
+	}
+
+	return used;
+}
+
+unsigned ParticleWorld::addContacts(ContactGenerators& generators, unsigned next)
+{
+	unsigned used = 0;
+
+	for (ContactGenerators::iterator g = generators.begin(); g != generators.end(); g++)
+		used += addContacts(*g, next + used);
+
+	if (next + used > contactHighWater)
+		contactHighWater = next + used;
+
+	return used;
+}
+
+void ParticleWorld::prepareContacts()
+{
+	contactLimitReached = false;
+	stats.droppedContacts = 0;
+
+	//Make room for as many contacts as last time
+	if (!contacts && contactCapacity > 0)
+		contacts = arena.allocate<ParticleContact>(contactCapacity);
 }
 
 unsigned ParticleWorld::generateContacts()
 {
-	int limit = maxContacts;
-	ParticleContact *nextContact = contacts;
+	PTRACE_ZONE("ParticleWorld::generateContacts");
 
-	//generate contacts for particles
-	unsigned used = particleContactGenerator[0]->addContact(nextContact, limit);
-	limit -= used;
-	nextContact += used;
+	//Timed from here, so that the contact stages' figures are right when called on its own
+	beginStages();
+	prepareContacts();
 
-	//If the max number of contacts has been exceeded, do not attempt to generate contacts for platforms,
-	//and return the number of contacts used (all of them)
-	if (limit <= 0)
-		return maxContacts;
+	//generate contacts for platforms first, so that if the limit is reached, it is the
+	//contacts between particles that are lost rather than those holding them up
+	unsigned used = addContacts(platformContactGenerators, 0);
+	endStage(STAGE_PLATFORM_CONTACTS);
 
-	//generate contacts for platforms
-	for (ContactGenerators::iterator g = platformContactGenerators.begin(); g != platformContactGenerators.end(); g++)
+	used += addContacts(particleContactGenerator, used);
+	endStage(STAGE_PARTICLE_CONTACTS);
+
+	return used;
+}
+
+void ParticleWorld::setContactLimit(unsigned maxContacts)
+{
+	ParticleWorld::maxContacts = maxContacts;
+
+	if (contactCapacity > maxContacts)
+		contactCapacity = maxContacts;
+}
+
+unsigned ParticleWorld::getContactLimit() const
+{
+	return maxContacts;
+}
+
+unsigned ParticleWorld::getContactCapacity() const
+{
+	return contactCapacity;
+}
+
+unsigned ParticleWorld::getContactHighWater() const
+{
+	return contactHighWater;
+}
+
+bool ParticleWorld::isContactLimitReached() const
+{
+	return contactLimitReached;
+}
+
+ParticleStore* ParticleWorld::getBatchStore() const
+{
+	if (particles.empty())
+		return 0;
+
+	//Nothing has changed since the particles were last checked
+	if (batchStoreValid && batchCandidate->getLiveCount() == batchLiveCount)
+		return batchStore;
+
+	batchCandidate = particles[0]->getStore();
+	batchLiveCount = batchCandidate->getLiveCount();
+	batchStore = findBatchStore();
+	batchStoreValid = true;
+
+	return batchStore;
+}
+
+ParticleStore* ParticleWorld::findBatchStore() const
+{
+	//The store can only be processed in one go if every particle in it is in this world
+	ParticleStore* store = particles[0]->getStore();
+
+	if (store->getLiveCount() != particles.size())
+		return 0;
+
+	for (Particles::const_iterator p = particles.begin(); p != particles.end(); p++)
+		if ((*p)->getStore() != store)
+			return 0;
+
+	return store;
+}
+
+//The number of particles each thread processes at a time. A multiple of the store's width, so
+//that every chunk but the last runs entirely in the vector kernels.
+static const unsigned PARTICLE_GRAIN = 1024;
+
+//What the threads of the batch passes over the store need to know
+struct BatchPass
+{
+	ParticleStore* store;
+	const ParticleForceTerms* terms;
+	float duration;
+};
+
+static void applyForcesRange(void* context, unsigned begin, unsigned end, unsigned)
+{
+	BatchPass* pass = (BatchPass*)context;
+	pass->store->applyForces(*pass->terms, begin, end);
+}
+
+static void integrateRange(void* context, unsigned begin, unsigned end, unsigned)
+{
+	BatchPass* pass = (BatchPass*)context;
+	pass->store->integrate(pass->duration, begin, end);
+}
+
+void ParticleWorld::applyForces(float duration)
+{
+	PTRACE_ZONE("ParticleWorld::applyForces");
+
+	//Combine the generators that can be batched into one set of terms
+	ParticleForceTerms terms;
+	bool batched = false;
+
+	unbatchedGenerators.clear();
+
+	for (ForceGenerators::iterator g = forceGenerators.begin(); g != forceGenerators.end(); g++)
+	{
+		if ((*g)->addBatchTerms(terms))
+			batched = true;
+		else
+			unbatchedGenerators.push_back(*g);
+	}
+
+	if (batched)
 	{
-		used = (*g)->addContact(nextContact, limit);
-		limit -= used;
-		nextContact += used;
+		ParticleStore* store = getBatchStore();
 
-		// We've run out of contacts to fill. This means we're missing
-		// contacts.
-		if (limit <= 0)
-			break;
+		if (store && jobs)
+		{
+			BatchPass pass = { store, &terms, duration };
+			jobs->parallelFor(store->getSize(), PARTICLE_GRAIN, applyForcesRange, &pass);
+		}
+		else if (store)
+			store->applyForces(terms, 0, store->getSize());
+		else
+			for (Particles::iterator p = particles.begin(); p != particles.end(); p++)
+				(*p)->getStore()->applyForces(terms, (*p)->getStoreIndex(), (*p)->getStoreIndex() + 1);
 	}
 
-	// Return the number of contacts used.
-	return maxContacts - limit;
+	//The rest are applied to each particle in turn
+	for (ForceGenerators::iterator g = unbatchedGenerators.begin(); g != unbatchedGenerators.end(); g++)
+		for (Particles::iterator p = particles.begin(); p != particles.end(); p++)
+			if ((*p)->isAwake())
+				(*g)->updateForce(*p, duration);
+
+	registry.updateForces(duration);
 }
 
 void ParticleWorld::integrate(float duration)
 {
+	PTRACE_ZONE("ParticleWorld::integrate");
+
+	ParticleStore* store = getBatchStore();
+
+	if (store && jobs)
+	{
+		BatchPass pass = { store, 0, duration };
+		jobs->parallelFor(store->getSize(), PARTICLE_GRAIN, integrateRange, &pass);
+		return;
+	}
+
+	if (store)
+	{
+		store->integrate(duration, 0, store->getSize());
+		return;
+	}
+
 	for (Particles::iterator p = particles.begin(); p != particles.end(); p++)
 	{
 		// Remove all forces from the accumulator
@@ -57,44 +288,414 @@ void ParticleWorld::integrate(float duration)
 	}
 }
 
-void ParticleWorld::runPhysics(float duration)
+//Returns true if the particle can be moved by a contact right now
+static bool isActive(const Particle* particle)
+{
+	return particle && particle->isAwake() && particle->getInverseMass() > 0;
+}
+
+void ParticleWorld::wakeTouched(unsigned numContacts)
+{
+	for (unsigned i = 0; i < numContacts; i++)
+	{
+		Particle** particle = contacts[i].particle;
+
+		if (!particle[1])
+			continue;
+
+		if (isActive(particle[0]) && !particle[1]->isAwake())
+			particle[1]->setAwake();
+		else if (isActive(particle[1]) && !particle[0]->isAwake())
+			particle[0]->setAwake();
+	}
+}
+
+void ParticleWorld::wakeIslands()
+{
+	unsigned keptIslands = 0;
+	unsigned keptParticles = 0;
+
+	for (unsigned i = 0; i < sleepingIslands.size(); i++)
+	{
+		unsigned begin = sleepingIslands[i].particleBegin;
+		unsigned end = begin + sleepingIslands[i].particleCount;
+
+		bool woken = false;
+		for (unsigned j = begin; j < end && !woken; j++)
+			woken = sleepingParticles[j]->isAwake();
+
+		if (woken)
+		{
+			for (unsigned j = begin; j < end; j++)
+				sleepingParticles[j]->setAwake();
+
+			continue;
+		}
+
+		//Islands still asleep are moved down over those that have woken
+		sleepingIslands[keptIslands].particleBegin = keptParticles;
+		sleepingIslands[keptIslands].particleCount = end - begin;
+		keptIslands++;
+
+		for (unsigned j = begin; j < end; j++)
+			sleepingParticles[keptParticles++] = sleepingParticles[j];
+	}
+
+	sleepingIslands.resize(keptIslands);
+	sleepingParticles.resize(keptParticles);
+}
+
+void ParticleWorld::updateSleep(float duration)
 {
-	//Apply drag force to every particle
+	PTRACE_ZONE("ParticleWorld::updateSleep");
+
+	float squareSleepSpeed = sleepSpeed * sleepSpeed;
+
+	//Time how long each particle has been slow for
 	for (Particles::iterator p = particles.begin(); p != particles.end(); p++)
 	{
-		float radius = (*p)->getRadius();
-		Vector2 velocity = (*p)->getVelocity();
-		float magnitude = velocity.magnitude();
+		if (!isActive(*p))
+			continue;
+
+		if ((*p)->getVelocity().squareMagnitude() < squareSleepSpeed)
+			(*p)->setSleepTime((*p)->getSleepTime() + duration);
+		else
+			(*p)->setSleepTime(0);
+	}
 
-		float k2 = 0.1 * radius * radius;
-		float dragCoeff = k2 * magnitude * magnitude;
+	//An island has only been slow for as long as its least slow particle, so hold the
+	//particles of islands that are not ready to sleep back to that
+	const std::vector<ParticleIsland>& found = islands.getIslands();
+	const std::vector<Particle*>& islandParticles = islands.getParticles();
 
-		Vector2 dragForce = velocity;
-		dragForce *= -dragCoeff;
-		dragForce.normalise();
-		dragForce *= 50; //normalised drag force is too small to produce much effect, so scale it up
-		(*p)->addForce(dragForce);
+	for (unsigned i = 0; i < found.size(); i++)
+	{
+		unsigned begin = found[i].particleBegin;
+		unsigned end = begin + found[i].particleCount;
+
+		if (begin == end)
+			continue;
+
+		float islandSleepTime = islandParticles[begin]->getSleepTime();
+		for (unsigned j = begin + 1; j < end; j++)
+			if (islandParticles[j]->getSleepTime() < islandSleepTime)
+				islandSleepTime = islandParticles[j]->getSleepTime();
+
+		//Remember who the island sleeps with (a particle alone wakes by itself)
+		if (islandSleepTime >= timeToSleep)
+		{
+			if (end - begin > 1)
+			{
+				SleepingIsland island = { (unsigned)sleepingParticles.size(), end - begin };
+				sleepingIslands.push_back(island);
+				sleepingParticles.insert(sleepingParticles.end(), islandParticles.begin() + begin, islandParticles.begin() + end);
+			}
+
+			continue;
+		}
+
+		for (unsigned j = begin; j < end; j++)
+			if (islandParticles[j]->getSleepTime() > islandSleepTime)
+				islandParticles[j]->setSleepTime(islandSleepTime);
 	}
 
+	//Everything left that has been slow for long enough can sleep
+	for (Particles::iterator p = particles.begin(); p != particles.end(); p++)
+		if (isActive(*p) && (*p)->getSleepTime() >= timeToSleep)
+			(*p)->setAwake(false);
+}
+
+//Holds a contact's pair id and where it was in the list, so contacts can be sorted
+//by pair id while keeping the order of those with the same id
+struct ContactKey
+{
+	unsigned long long pairId;
+	unsigned index;
+
+	bool operator<(const ContactKey& other) const
+	{
+		if (pairId != other.pairId)
+			return pairId < other.pairId;
+
+		return index < other.index;
+	}
+};
+
+//Sorts contacts by pair id, keeping the order of those with the same id, using scratch space from the arena
+static void sortByPairId(ParticleContact* contacts, unsigned count, FrameArena& arena)
+{
+	ContactKey* keys = arena.allocate<ContactKey>(count);
+	ParticleContact* sorted = arena.allocate<ParticleContact>(count);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		keys[i].pairId = contacts[i].pairId;
+		keys[i].index = i;
+	}
+
+	std::sort(keys, keys + count);
+
+	for (unsigned i = 0; i < count; i++)
+		sorted[i] = contacts[keys[i].index];
+
+	std::copy(sorted, sorted + count, contacts);
+}
+
+void ParticleWorld::runPhysics(float duration)
+{
+	PTRACE_FRAME("ParticleWorld::runPhysics");
+
+	beginStages();
+
+	// Last frame's contacts and scratch space are finished with
+	arena.reset();
+	contacts = 0;
+
+	// First apply the force generators
+	applyForces(duration);
+	endStage(STAGE_FORCES);
+
 	// Then integrate the objects
 	integrate(duration);
+	endStage(STAGE_INTEGRATE);
 
-	// Generate contacts
+	// Generate contacts, with the platforms and then between particles
 	unsigned usedContacts = generateContacts();
 
+	// Put them in an order that does not depend on the threads that found them
+	if (deterministic)
+		sortByPairId(contacts, usedContacts, arena);
+
+	// Anything that has been touched by a moving particle has to move too, along with
+	// everything it went to sleep with
+	wakeTouched(usedContacts);
+	wakeIslands();
+
+	// Split them into islands that can be resolved independently
+	islands.build(contacts, usedContacts);
+	const std::vector<ParticleIsland>& found = islands.getIslands();
+
 	// And process them
-	if (usedContacts)
+
+	//Sequential impulses are always run (even with no contacts, so that the impulses
+	//they remember are cleared), and work with a fixed number of iterations
+	stats.iterationsUsed = 0;
+
+	if (resolver.usesSequentialImpulses())
+	{
+		resolver.resolveContacts(contacts, usedContacts, found.empty() ? 0 : &found[0], found.size(), duration);
+		stats.iterationsUsed = resolver.getIterationsUsed();
+	}
+	else if (calculateIterations)
 	{
-		if (calculateIterations) resolver.setIterations(usedContacts * 2);
+		//Each island gets the iterations its own contacts call for
+		for (unsigned i = 0; i < found.size(); i++)
+		{
+			resolver.setIterations(found[i].contactCount * 2);
+			resolver.resolveContacts(contacts + found[i].contactBegin, found[i].contactCount, duration);
+			stats.iterationsUsed += resolver.getIterationsUsed();
+		}
+	}
+	else if (usedContacts)
+	{
+		//A fixed number of iterations is shared between all the contacts
 		resolver.resolveContacts(contacts, usedContacts, duration);
+		stats.iterationsUsed = resolver.getIterationsUsed();
+	}
+
+	// Put to sleep whatever has come to rest
+	if (sleeping)
+		updateSleep(duration);
+
+	endStage(STAGE_RESOLVE);
+
+	// Note how well the contacts were resolved (outside the timed stages)
+	stats.contacts = usedContacts;
+	stats.maxClosingVelocity = ParticleContactResolver::calculateMaxClosingVelocity(contacts, usedContacts);
+	recordHistory();
+}
+
+void ParticleWorld::beginStages()
+{
+	stageStart = AllocationCounter::getCounts();
+	stageStartTime = std::chrono::steady_clock::now();
+}
+
+void ParticleWorld::endStage(ParticleWorldStage stage)
+{
+	std::chrono::steady_clock::time_point nowTime = std::chrono::steady_clock::now();
+	AllocationCounts now = AllocationCounter::getCounts();
+
+	stats.stageTime[stage] = std::chrono::duration_cast<std::chrono::nanoseconds>(nowTime - stageStartTime).count();
+	stats.stageAllocations[stage].allocations = now.allocations - stageStart.allocations;
+	stats.stageAllocations[stage].bytes = now.bytes - stageStart.bytes;
+
+	stageStartTime = nowTime;
+	stageStart = now;
+}
+
+void ParticleWorld::recordHistory()
+{
+	unsigned long long total = 0;
+
+	for (unsigned stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		stageHistory[stage][historyNext] = stats.stageTime[stage];
+		total += stats.stageTime[stage];
 	}
+
+	stageHistory[STAGE_COUNT][historyNext] = total;
+
+	historyNext = (historyNext + 1) % STATS_WINDOW;
+	if (historyCount < STATS_WINDOW)
+		historyCount++;
+}
+
+const AllocationCounts& ParticleWorld::getStageAllocations(ParticleWorldStage stage) const
+{
+	return stats.stageAllocations[stage];
+}
+
+AllocationCounts ParticleWorld::getStepAllocations() const
+{
+	AllocationCounts total;
+
+	for (unsigned stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		total.allocations += stats.stageAllocations[stage].allocations;
+		total.bytes += stats.stageAllocations[stage].bytes;
+	}
+
+	return total;
+}
+
+const ParticleWorldStats& ParticleWorld::getStats() const
+{
+	return stats;
+}
+
+unsigned long long ParticleWorld::getStagePercentile(ParticleWorldStage stage, float percentile) const
+{
+	if (historyCount == 0)
+		return 0;
+
+	std::copy(stageHistory[stage], stageHistory[stage] + historyCount, percentileScratch);
+
+	//Take the smallest time that at least the given percentage of the steps were no slower than
+	float rank = percentile / 100.0f * historyCount;
+	unsigned index = rank > 1 ? (unsigned)ceilf(rank) - 1 : 0;
+	if (index >= historyCount)
+		index = historyCount - 1;
+
+	std::nth_element(percentileScratch, percentileScratch + index, percentileScratch + historyCount);
+	return percentileScratch[index];
+}
+
+void ParticleWorld::setSleeping(bool sleeping, float sleepSpeed, float timeToSleep)
+{
+	ParticleWorld::sleeping = sleeping;
+	ParticleWorld::sleepSpeed = sleepSpeed;
+	ParticleWorld::timeToSleep = timeToSleep;
+
+	//Nothing may stay asleep once sleeping is turned off
+	if (!sleeping)
+	{
+		for (Particles::iterator p = particles.begin(); p != particles.end(); p++)
+			(*p)->setAwake();
+
+		sleepingIslands.clear();
+		sleepingParticles.clear();
+	}
+}
+
+void ParticleWorld::setJobSystem(JobSystem* jobs)
+{
+	ParticleWorld::jobs = jobs;
+	resolver.setJobSystem(jobs);
+
+	for (ContactGenerators::iterator g = particleContactGenerator.begin(); g != particleContactGenerator.end(); g++)
+		(*g)->setJobSystem(jobs);
+	for (ContactGenerators::iterator g = platformContactGenerators.begin(); g != platformContactGenerators.end(); g++)
+		(*g)->setJobSystem(jobs);
+}
+
+void ParticleWorld::setDeterministic(bool deterministic)
+{
+	ParticleWorld::deterministic = deterministic;
+	resolver.setDeterministic(deterministic);
+}
+
+FrameArena& ParticleWorld::getFrameArena()
+{
+	return arena;
+}
+
+bool ParticleWorld::isDeterministic() const
+{
+	return deterministic;
+}
+
+//Adds the bytes of a value to a 64-bit FNV-1a hash
+static void hashBytes(unsigned long long& hash, const void* data, unsigned size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	for (unsigned i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+unsigned long long ParticleWorld::calculateStateHash() const
+{
+	unsigned long long hash = 14695981039346656037ull;
+
+	for (Particles::const_iterator p = particles.begin(); p != particles.end(); p++)
+	{
+		Vector2 position = (*p)->getPosition();
+		Vector2 velocity = (*p)->getVelocity();
+		float state[4] = { position.x, position.y, velocity.x, velocity.y };
+		char awake = (*p)->isAwake();
+
+		hashBytes(hash, state, sizeof(state));
+		hashBytes(hash, &awake, sizeof(awake));
+	}
+
+	return hash;
+}
+
+ParticleContactResolver& ParticleWorld::getResolver()
+{
+	return resolver;
+}
+
+const ParticleIslands& ParticleWorld::getIslands() const
+{
+	return islands;
 }
 
 ParticleWorld::Particles& ParticleWorld::getParticles()
 {
+	//The list may change, so the store has to be checked again, and particles removed from
+	//the world must not be woken by it
+	batchStoreValid = false;
+	sleepingIslands.clear();
+	sleepingParticles.clear();
+
 	return particles;
 }
 
+ParticleWorld::ForceGenerators& ParticleWorld::getForceGenerators()
+{
+	return forceGenerators;
+}
+
+ParticleForceRegistry& ParticleWorld::getForceRegistry()
+{
+	return registry;
+}
+
 ParticleWorld::ContactGenerators& ParticleWorld::getPlatformContactGenerators()
 {
 	return platformContactGenerators;
@@ -0,0 +1,146 @@
+/*
+ * Stands a column of spheres on a floor and checks that the sequential
+ * impulse solver brings it to rest: the spheres must end up still,
+ * upright and overlapping each other and the floor by no more than a
+ * little. Exits with a non-zero status if they do not.
+ *
+ */
+#include "pworld.h"
+#include "pplatform.h"
+#include "ParticleCollision.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+static void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  --n N            number of spheres in the column (default 8)\n");
+	printf("  --passes N       passes the solver makes over the contacts (default 6)\n");
+	printf("  --frames N       number of steps to run (default 500)\n");
+	printf("  --max-overlap D  largest overlap allowed once settled (default 0.07)\n");
+	printf("  --max-speed V    largest speed allowed once settled (default 1)\n");
+}
+
+int main(int argc, char** argv)
+{
+	unsigned count = 8;
+	unsigned passes = 6;
+	unsigned frames = 500;
+	float maxOverlap = 0.07f;
+	float maxSpeed = 1.0f;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--n") == 0 && hasValue)
+			count = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--passes") == 0 && hasValue)
+			passes = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+			frames = (unsigned)strtoul(argv[++i], 0, 10);
+		else if (strcmp(argv[i], "--max-overlap") == 0 && hasValue)
+			maxOverlap = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--max-speed") == 0 && hasValue)
+			maxSpeed = (float)atof(argv[++i]);
+		else
+		{
+			printUsage(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (count < 1 || passes < 1)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	//The same size of sphere and strength of gravity as the benchmark's stack scene, with each
+	//sphere starting just touching the one below
+	const float radius = 3.0f;
+	const float floor = 0.0f;
+
+	ParticleStore store(count);
+	std::vector<Particle> particles;
+	particles.reserve(count);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		particles.emplace_back(store);
+
+		Particle& particle = particles.back();
+		particle.setPosition(0, floor + radius * (1.0f + 2.0f * i));
+		particle.setRadius(radius);
+		particle.setMass(5.0f);
+		particle.setVelocity(0, 0);
+		particle.clearAccumulator();
+	}
+
+	Platform platform;
+	platform.id = 0;
+	platform.start = Vector2(-50, floor);
+	platform.end = Vector2(50, floor);
+	platform.setRestitution(0.0f);
+
+	ParticleCollision collision((int)count, particles.data());
+	ParticleGravity gravity(Vector2::GRAVITY * 20.0f);
+
+	ParticleWorld world(count * 8 + 64);
+	world.getParticleContactGenerator().push_back(&collision);
+	world.getPlatformContactGenerators().push_back(&platform);
+	world.getForceGenerators().push_back(&gravity);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		platform.particle.push_back(&particles[i]);
+		world.getParticles().push_back(&particles[i]);
+	}
+
+	//Sleeping would stop the spheres whether or not the solver had, so it stays off
+	world.getResolver().setSequentialImpulses(true, passes);
+	world.setSleeping(false);
+
+	for (unsigned i = 0; i < frames; i++)
+		world.runPhysics(0.01f);
+
+	//How far each sphere sinks into the floor or the sphere below, how fast the fastest is moving,
+	//and how far the column has leant over
+	float overlap = radius - (particles[0].getPosition().y - floor);
+	float speed = 0;
+	float drift = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		Vector2 position = particles[i].getPosition();
+
+		if (i > 0)
+		{
+			float gap = (position - particles[i - 1].getPosition()).magnitude() - 2.0f * radius;
+			if (-gap > overlap)
+				overlap = -gap;
+		}
+
+		float magnitude = particles[i].getVelocity().magnitude();
+		if (magnitude > speed)
+			speed = magnitude;
+
+		if (fabs(position.x) > drift)
+			drift = fabs(position.x);
+	}
+
+	printf("spheres: %u\n", count);
+	printf("passes: %u\n", passes);
+	printf("max overlap: %g\n", overlap);
+	printf("max speed: %g\n", speed);
+	printf("drift: %g\n", drift);
+
+	bool settled = overlap <= maxOverlap && speed <= maxSpeed && drift <= radius * 0.5f;
+	if (!settled)
+		fprintf(stderr, "The column did not come to rest\n");
+
+	return settled ? 0 : 1;
+}